@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui svg
+QT       += core gui svg network concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -24,6 +24,10 @@ DEFINES += QT_DEPRECATED_WARNINGS
 
 CONFIG += c++11 lrelease embed_translations
 
+# PNG export compresses stripes with zlib directly, use the zlib bundled with Qt when there is no system one
+unix: LIBS += -lz
+win32: INCLUDEPATH += $$[QT_INSTALL_HEADERS]/QtZlib
+
 SOURCES += \
         main.cpp \
         mainwindow.cpp \
@@ -34,7 +38,33 @@ SOURCES += \
     opacityhelper.cpp \
     toolbutton.cpp \
     settings.cpp \
-    settingsdialog.cpp
+    settingsdialog.cpp \
+    formatdispatcher.cpp \
+    singleinstance.cpp \
+    startuptimer.cpp \
+    imageloader.cpp \
+    slideshow.cpp \
+    navigationloader.cpp \
+    imagemimedata.cpp \
+    pngstripeencoder.cpp \
+    imageexporter.cpp \
+    batchconverter.cpp \
+    imagestatistics.cpp \
+    histogramview.cpp \
+    pipelinestats.cpp \
+    imagememory.cpp \
+    pageloader.cpp \
+    embeddedpreview.cpp \
+    paralleldecoder.cpp \
+    regionloader.cpp \
+    imagecache.cpp \
+    taskscheduler.cpp \
+    shutdown.cpp \
+    glviewport.cpp \
+    pixmapitem.cpp \
+    imagedifference.cpp \
+    compareview.cpp \
+    jpegorientation.cpp
 
 HEADERS += \
         mainwindow.h \
@@ -45,7 +75,33 @@ HEADERS += \
     opacityhelper.h \
     toolbutton.h \
     settings.h \
-    settingsdialog.h
+    settingsdialog.h \
+    formatdispatcher.h \
+    singleinstance.h \
+    startuptimer.h \
+    imageloader.h \
+    slideshow.h \
+    navigationloader.h \
+    imagemimedata.h \
+    pngstripeencoder.h \
+    imageexporter.h \
+    batchconverter.h \
+    imagestatistics.h \
+    histogramview.h \
+    pipelinestats.h \
+    imagememory.h \
+    pageloader.h \
+    embeddedpreview.h \
+    paralleldecoder.h \
+    regionloader.h \
+    imagecache.h \
+    taskscheduler.h \
+    shutdown.h \
+    glviewport.h \
+    pixmapitem.h \
+    imagedifference.h \
+    compareview.h \
+    jpegorientation.h
 
 TRANSLATIONS = \
     languages/PineapplePictures.ts \
@@ -0,0 +1,253 @@
+#include "batchconverter.h"
+
+#include "formatdispatcher.h"
+#include "imageloader.h"
+
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QSemaphore>
+#include <QSet>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+
+namespace {
+
+struct Statistics
+{
+    QAtomicInt             succeeded { 0 };
+    QAtomicInt             failed { 0 };
+    QAtomicInteger<qint64> bytesRead { 0 };
+    QAtomicInteger<qint64> bytesWritten { 0 };
+    QAtomicInteger<qint64> pixelsDecoded { 0 };
+};
+
+QByteArray outputFormat(const QByteArray &inputFormat, const BatchConverter::Options &options)
+{
+    QByteArray format = options.format.isEmpty() ? inputFormat : options.format;
+    if (format.isEmpty() || !QImageWriter::supportedImageFormats().contains(format)) {
+        format = "png";
+    }
+    return format;
+}
+
+// 用于比较路径是否指向同一个文件
+QString pathKey(const QString &path)
+{
+    const QString cleaned = QDir::cleanPath(QFileInfo(path).absoluteFilePath());
+#if defined(Q_OS_WIN) || defined(Q_OS_MACOS)
+    return cleaned.toLower();
+#else
+    return cleaned;
+#endif
+}
+
+class ConvertTask : public QRunnable
+{
+public:
+    ConvertTask(const QString &inputPath, const QByteArray &inputFormat, const QString &outputPath,
+                const BatchConverter::Options &options,
+                QSemaphore *memoryBudget, Statistics *statistics, QMutex *outputMutex)
+        : m_inputPath(inputPath)
+        , m_inputFormat(inputFormat)
+        , m_outputPath(outputPath)
+        , m_options(options)
+        , m_memoryBudget(memoryBudget)
+        , m_statistics(statistics)
+        , m_outputMutex(outputMutex)
+    {
+    }
+
+    void run() override
+    {
+        QElapsedTimer timer;
+        timer.start();
+
+        // 按解码后的全尺寸估计内存，只读取文件头
+        QImageReader reader(m_inputPath, m_inputFormat);
+        const QSize fullSize = reader.size();
+        const qint64 estimatedMB = fullSize.isValid() ? qint64(fullSize.width()) * fullSize.height() * 4 / (1024 * 1024) + 1 : 1;
+        const int acquiredMB = static_cast<int>(qMin<qint64>(estimatedMB, m_options.memoryBudgetMB));
+
+        m_memoryBudget->acquire(acquiredMB);
+        QString errorString;
+        QImage image = ImageLoader::decode(m_inputPath, m_options.resize > 0 ? QSize(m_options.resize, m_options.resize)
+                                                                             : QSize());
+        if (image.isNull()) {
+            errorString = QStringLiteral("cannot decode");
+        } else {
+            m_statistics->pixelsDecoded.fetchAndAddRelaxed(qint64(image.width()) * image.height());
+            errorString = write(image);
+        }
+        m_memoryBudget->release(acquiredMB);
+
+        m_statistics->bytesRead.fetchAndAddRelaxed(QFileInfo(m_inputPath).size());
+
+        QMutexLocker locker(m_outputMutex);
+        QTextStream out(stdout);
+        if (errorString.isEmpty()) {
+            m_statistics->succeeded.fetchAndAddRelaxed(1);
+            out << m_inputPath << " -> " << m_outputPath << " (" << image.width() << "x" << image.height()
+                << ", " << timer.elapsed() << " ms)" << '\n';
+        } else {
+            m_statistics->failed.fetchAndAddRelaxed(1);
+            QTextStream err(stderr);
+            err << m_inputPath << ": " << errorString << '\n';
+        }
+    }
+
+private:
+    QString write(const QImage &image)
+    {
+        // 先写到临时文件，失败时不会留下不完整的输出
+        QSaveFile file(m_outputPath);
+        if (!file.open(QIODevice::WriteOnly)) {
+            return file.errorString();
+        }
+
+        QImageWriter writer(&file, outputFormat(m_inputFormat, m_options));
+        writer.setQuality(m_options.quality);
+        if (!writer.write(image)) {
+            file.cancelWriting();
+            return writer.errorString();
+        }
+        if (!file.commit()) {
+            return file.errorString();
+        }
+
+        m_statistics->bytesWritten.fetchAndAddRelaxed(QFileInfo(m_outputPath).size());
+        return QString();
+    }
+
+    QString m_inputPath;
+    QByteArray m_inputFormat;
+    QString m_outputPath;
+    const BatchConverter::Options &m_options;
+    QSemaphore *m_memoryBudget;
+    Statistics *m_statistics;
+    QMutex *m_outputMutex;
+};
+
+} // namespace
+
+bool BatchConverter::isRequested(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        if (qstrcmp(argv[i], "--convert") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int BatchConverter::exec(int &argc, char *argv[])
+{
+    // 不创建任何窗口，没有显示器的机器上也可以运行(SVG 中的文字仍然需要字体)
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Batch convert or thumbnail images."));
+    parser.addPositionalArgument("files", QStringLiteral("Input files."), "files...");
+    QCommandLineOption convertOption("convert", QStringLiteral("Run in batch conversion mode."));
+    QCommandLineOption outOption("out", QStringLiteral("Output directory."), "dir");
+    QCommandLineOption resizeOption("resize", QStringLiteral("Fit images into a <size> x <size> box."), "size");
+    QCommandLineOption formatOption("format", QStringLiteral("Output format, e.g. jpg, png, webp."), "format");
+    QCommandLineOption qualityOption("quality", QStringLiteral("Output quality (0-100)."), "quality");
+    QCommandLineOption jobsOption("jobs", QStringLiteral("Number of worker threads."), "n");
+    QCommandLineOption memoryOption("memory", QStringLiteral("Memory budget for decoded images in MB."), "mb");
+    parser.addOptions({ convertOption, outOption, resizeOption, formatOption, qualityOption, jobsOption, memoryOption });
+    parser.addHelpOption();
+    parser.process(app);
+
+    Options options;
+    options.inputs = parser.positionalArguments();
+    options.outputDir = parser.value(outOption);
+    options.resize = parser.value(resizeOption).toInt();
+    options.format = parser.value(formatOption).toLower().toLatin1();
+    if (options.format == "jpg") {
+        options.format = "jpeg";
+    }
+    if (parser.isSet(qualityOption)) {
+        options.quality = parser.value(qualityOption).toInt();
+    }
+    options.jobs = parser.value(jobsOption).toInt();
+    if (parser.isSet(memoryOption)) {
+        options.memoryBudgetMB = qMax(1, parser.value(memoryOption).toInt());
+    }
+
+    if (options.inputs.isEmpty() || options.outputDir.isEmpty()) {
+        QTextStream(stderr) << "Usage: ppic --convert [--resize N] [--format FMT] --out DIR FILES..." << '\n';
+        return 2;
+    }
+
+    return run(options);
+}
+
+int BatchConverter::run(const Options &options)
+{
+    if (!QDir().mkpath(options.outputDir)) {
+        QTextStream(stderr) << "Cannot create output directory " << options.outputDir << '\n';
+        return 2;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(options.jobs > 0 ? options.jobs : QThread::idealThreadCount());
+    QSemaphore memoryBudget(options.memoryBudgetMB);
+    Statistics statistics;
+    QMutex outputMutex;
+
+    // 在开始之前按输入顺序确定所有输出路径，重名时依次加上 _2、_3……，
+    // 结果与线程的调度无关；输入文件也算作已占用，输出到输入所在的目录时不会覆盖任何一个输入文件
+    QSet<QString> takenPaths;
+    for (const QString &input : options.inputs) {
+        takenPaths.insert(pathKey(input));
+    }
+
+    const QDir outputDir(options.outputDir);
+    for (const QString &input : options.inputs) {
+        const QString inputPath = QFileInfo(input).absoluteFilePath();
+        const QByteArray inputFormat = FormatDispatcher::instance()->sniff(inputPath).format;
+        const QByteArray format = outputFormat(inputFormat, options);
+        const QString suffix = format == "jpeg" ? QStringLiteral("jpg") : QString::fromLatin1(format);
+        const QString baseName = QFileInfo(inputPath).completeBaseName();
+
+        QString outputPath = outputDir.absoluteFilePath(baseName + '.' + suffix);
+        for (int n = 2; takenPaths.contains(pathKey(outputPath)); n++) {
+            outputPath = outputDir.absoluteFilePath(QStringLiteral("%1_%2.%3").arg(baseName, QString::number(n), suffix));
+        }
+        takenPaths.insert(pathKey(outputPath));
+
+        pool.start(new ConvertTask(inputPath, inputFormat, outputPath, options,
+                                   &memoryBudget, &statistics, &outputMutex));
+    }
+    pool.waitForDone();
+
+    const double seconds = qMax<qint64>(1, timer.elapsed()) / 1000.0;
+    const int succeeded = statistics.succeeded.loadAcquire();
+    const int failed = statistics.failed.loadAcquire();
+    QTextStream err(stderr);
+    err << QStringLiteral("%1 converted, %2 failed in %3 s using %4 threads: %5 images/s, %6 MP/s, %7 MB/s read, %8 MB/s written")
+           .arg(succeeded).arg(failed).arg(seconds, 0, 'f', 2).arg(pool.maxThreadCount())
+           .arg(succeeded / seconds, 0, 'f', 1)
+           .arg(statistics.pixelsDecoded.loadAcquire() / 1e6 / seconds, 0, 'f', 1)
+           .arg(statistics.bytesRead.loadAcquire() / 1048576.0 / seconds, 0, 'f', 1)
+           .arg(statistics.bytesWritten.loadAcquire() / 1048576.0 / seconds, 0, 'f', 1)
+        << '\n';
+
+    return failed > 0 ? 1 : 0;
+}
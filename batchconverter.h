@@ -0,0 +1,31 @@
+#ifndef BATCHCONVERTER_H
+#define BATCHCONVERTER_H
+
+#include <QByteArray>
+#include <QStringList>
+
+/**
+ * @brief 无窗口的批量转换/缩略图模式：ppic --convert [--resize N] --out DIR FILES...
+ *
+ * 与查看器使用同样的解码路径(格式探测、EXIF 方向)，多个文件在线程池中并行处理，
+ * 同时解码的图片占用的内存不会超过设定的上限。
+ */
+class BatchConverter
+{
+public:
+    struct Options {
+        QStringList inputs;
+        QString     outputDir;
+        QByteArray  format;          // 为空时沿用输入文件的格式
+        int         resize = 0;      // 长边不超过该尺寸，0 表示不缩放
+        int         quality = -1;
+        int         jobs = 0;        // 0 表示使用 CPU 核心数
+        int         memoryBudgetMB = 1024;
+    };
+
+    static bool isRequested(int argc, char *argv[]);
+    static int exec(int &argc, char *argv[]);
+    static int run(const Options &options);
+};
+
+#endif // BATCHCONVERTER_H
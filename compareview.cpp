@@ -0,0 +1,253 @@
+#include "compareview.h"
+
+#include "graphicsscene.h"
+#include "graphicsview.h"
+#include "imagecache.h"
+#include "imagedifference.h"
+#include "imageloader.h"
+#include "settings.h"
+
+#include <QContextMenuEvent>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QHBoxLayout>
+#include <QKeyEvent>
+#include <QMenu>
+#include <QWheelEvent>
+
+CompareView::CompareView(ImageCache *imageCache, QWidget *parent)
+    : QWidget(parent, Qt::Window)
+    , m_imageCache(imageCache)
+    , m_cancelled(new QAtomicInt(0))
+{
+    setAttribute(Qt::WA_DeleteOnClose);
+    setWindowTitle(tr("Compare"));
+    resize(1280, 720);
+
+    QHBoxLayout *layout = new QHBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->setSpacing(2);
+    for (int i = 0; i < SideCount; i++) {
+        const Side side = static_cast<Side>(i);
+        GraphicsView *view = new GraphicsView(this);
+        view->setScene(new GraphicsScene(view));
+        view->setOpenGLEnabled(Settings::instance()->openGLViewport());
+        // 对比窗口中的图片只能通过 compare() 替换
+        view->setAcceptDrops(false);
+        layout->addWidget(view);
+        m_views[side] = view;
+
+        connect(view, &GraphicsView::viewChanged, this, [this, side]() {
+            syncFrom(side);
+        });
+    }
+
+    // 差异在变换停止变化的下一帧才重新计算
+    connect(m_views[Second], &GraphicsView::viewStateChanged, this, &CompareView::updateDifference);
+}
+
+CompareView::~CompareView()
+{
+    m_cancelled->storeRelease(1);
+}
+
+void CompareView::compare(const QString &firstPath, const QString &secondPath)
+{
+    m_generation++;
+    m_cancelled->storeRelease(1);
+    m_cancelled.reset(new QAtomicInt(0));
+    m_differenceRunning = false;
+    m_differencePending = false;
+
+    setWindowTitle(tr("Compare") + QStringLiteral(" - %1 | %2")
+                   .arg(QFileInfo(firstPath).fileName(), QFileInfo(secondPath).fileName()));
+    load(First, firstPath);
+    load(Second, secondPath);
+}
+
+void CompareView::setDifferenceEnabled(bool enabled)
+{
+    m_differenceEnabled = enabled;
+    updateDifference();
+}
+
+bool CompareView::isDifferenceEnabled() const
+{
+    return m_differenceEnabled;
+}
+
+bool CompareView::canShowDifference() const
+{
+    return !m_images[First].isNull() && m_images[First].size() == m_images[Second].size();
+}
+
+void CompareView::wheelEvent(QWheelEvent *event)
+{
+    // GraphicsView 不处理滚轮，缩放鼠标下方的那一侧，另一侧随之同步
+    const QPoint numDegrees = event->angleDelta() / 8;
+    if (numDegrees.y() != 0) {
+        for (GraphicsView *view : m_views) {
+            if (view->geometry().contains(event->pos())) {
+                view->zoomView(numDegrees.y() > 0 ? 1.25 : 0.8);
+                event->accept();
+                return;
+            }
+        }
+    }
+
+    QWidget::wheelEvent(event);
+}
+
+void CompareView::contextMenuEvent(QContextMenuEvent *event)
+{
+    QMenu *menu = new QMenu(this);
+
+    QAction *difference = new QAction(tr("Show difference"), menu);
+    difference->setCheckable(true);
+    difference->setChecked(m_differenceEnabled);
+    difference->setEnabled(canShowDifference());
+    connect(difference, &QAction::triggered, this, &CompareView::setDifferenceEnabled);
+
+    QAction *rotate = new QAction(tr("Rotate right"), menu);
+    connect(rotate, &QAction::triggered, this, [this]() {
+        m_views[First]->rotateView(90);
+    });
+
+    QAction *closeAction = new QAction(tr("Close"), menu);
+    connect(closeAction, &QAction::triggered, this, &QWidget::close);
+
+    menu->addAction(difference);
+    menu->addAction(rotate);
+    menu->addSeparator();
+    menu->addAction(closeAction);
+    menu->exec(mapToGlobal(event->pos()));
+    menu->deleteLater();
+}
+
+void CompareView::keyPressEvent(QKeyEvent *event)
+{
+    if (event->key() == Qt::Key_Escape) {
+        close();
+        return;
+    }
+
+    QWidget::keyPressEvent(event);
+}
+
+void CompareView::load(Side side, const QString &filePath)
+{
+    m_images[side] = QImage();
+    m_views[side]->showText(tr("Loading..."));
+
+    // 图库已经解码过的图片直接使用；概览图不是完整的图片，不能用于对比。
+    // 只读地查找，不影响图库的缓存决定哪些图片留在内存中
+    QImage cached;
+    QSize fullSize;
+    ImageCache::ColdEntry cold;
+    if (m_imageCache && m_imageCache->peek(filePath, &cached, &fullSize, &cold)) {
+        if (cached.size() != fullSize) {
+            cached = QImage();
+        }
+    }
+
+    const int generation = m_generation;
+    const TaskScheduler::CancellationToken cancelled(m_cancelled);
+    QFutureWatcher<QImage> *watcher = new QFutureWatcher<QImage>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, generation, side]() {
+        watcher->deleteLater();
+        if (generation == m_generation) {
+            onImageLoaded(side, watcher->result());
+        }
+    });
+
+    watcher->setFuture(TaskScheduler::instance()->run(TaskScheduler::VisibleImage,
+                                                      [filePath, cached, cold, cancelled]() {
+        QImage image(cached);
+        if (image.isNull() && cold.isValid()) {
+            image = ImageCache::restore(cold, cancelled.data());
+            if (image.size() != cold.fullSize) {
+                image = QImage();
+            }
+        }
+        if (image.isNull()) {
+            image = ImageLoader::decode(filePath, QSize(), cancelled.data());
+        }
+        return image.convertToFormat(QImage::Format_ARGB32);
+    }, cancelled));
+}
+
+void CompareView::onImageLoaded(Side side, const QImage &image)
+{
+    if (image.isNull()) {
+        m_views[side]->showText(tr("File not is a valid image"));
+        return;
+    }
+
+    m_images[side] = image;
+    m_memory.reset(ImageMemory::bytesOf(m_images[First]) + ImageMemory::bytesOf(m_images[Second]));
+
+    m_views[side]->showImage(image);
+    // 后加载的一侧对齐到先加载的一侧
+    const Side other = side == First ? Second : First;
+    if (!m_images[other].isNull()) {
+        syncFrom(other);
+    }
+    updateDifference();
+}
+
+void CompareView::syncFrom(Side side)
+{
+    const Side other = side == First ? Second : First;
+    if (m_syncing || m_images[side].isNull() || m_images[other].isNull()) {
+        return;
+    }
+
+    // matchView() 本身也会发出 viewChanged，不能再反向同步
+    m_syncing = true;
+    m_views[other]->matchView(m_views[side]);
+    m_syncing = false;
+}
+
+void CompareView::updateDifference()
+{
+    GraphicsView *view = m_views[Second];
+    if (!m_differenceEnabled || !canShowDifference()) {
+        view->scene()->clearOverlay();
+        return;
+    }
+
+    if (m_differenceRunning) {
+        m_differencePending = true;
+        return;
+    }
+
+    const QRect region(view->mapToScene(view->viewport()->rect()).boundingRect().toAlignedRect()
+                       & m_images[Second].rect());
+    if (region.isEmpty()) {
+        return;
+    }
+
+    m_differenceRunning = true;
+    const int generation = m_generation;
+    QFutureWatcher<QImage> *watcher = new QFutureWatcher<QImage>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, generation, region]() {
+        watcher->deleteLater();
+        if (generation != m_generation) {
+            return;
+        }
+        m_differenceRunning = false;
+
+        const QImage difference = watcher->result();
+        if (m_differenceEnabled && !difference.isNull()) {
+            m_views[Second]->scene()->showOverlay(QPixmap::fromImage(difference), region);
+        }
+
+        // 计算期间视图又变化了
+        if (m_differencePending) {
+            m_differencePending = false;
+            updateDifference();
+        }
+    });
+
+    watcher->setFuture(ImageDifference::compute(m_images[First], m_images[Second], region));
+}
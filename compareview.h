@@ -0,0 +1,64 @@
+#ifndef COMPAREVIEW_H
+#define COMPAREVIEW_H
+
+#include "imagememory.h"
+#include "taskscheduler.h"
+
+#include <QImage>
+#include <QWidget>
+
+class GraphicsView;
+class ImageCache;
+
+/**
+ * @brief 并排对比两张图片的窗口
+ *
+ * 两个 GraphicsView 的缩放、平移和旋转始终一致：一侧变化时在同一事件中直接设置另一侧的变换，
+ * 不经过 viewStateChanged 的合并延迟。解码优先使用图库的 ImageCache 中已有的结果。
+ * 打开差异显示后，右侧在可见区域上叠加两张图片逐像素差的绝对值。
+ */
+class CompareView : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit CompareView(ImageCache *imageCache, QWidget *parent = nullptr);
+    ~CompareView() override;
+
+    void compare(const QString &firstPath, const QString &secondPath);
+
+    void setDifferenceEnabled(bool enabled);
+    bool isDifferenceEnabled() const;
+    // 两张图片都已加载并且大小相同时才能计算差异
+    bool canShowDifference() const;
+
+protected:
+    void wheelEvent(QWheelEvent *event) override;
+    void contextMenuEvent(QContextMenuEvent *event) override;
+    void keyPressEvent(QKeyEvent *event) override;
+
+private:
+    enum Side {
+        First,
+        Second,
+        SideCount
+    };
+
+    void load(Side side, const QString &filePath);
+    void onImageLoaded(Side side, const QImage &image);
+    void syncFrom(Side side);
+    void updateDifference();
+
+    ImageCache *m_imageCache;
+    GraphicsView *m_views[SideCount];
+    QImage m_images[SideCount];   // Format_ARGB32，用于计算差异
+    ImageMemoryTicket m_memory { ImageMemory::Scene };
+    TaskScheduler::CancellationToken m_cancelled;
+    int m_generation = 0;
+    bool m_syncing = false;
+
+    bool m_differenceEnabled = false;
+    bool m_differenceRunning = false;
+    bool m_differencePending = false;
+};
+
+#endif // COMPAREVIEW_H
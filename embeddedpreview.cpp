@@ -0,0 +1,388 @@
+#include "embeddedpreview.h"
+
+#include <QBuffer>
+#include <QFile>
+#include <QImageReader>
+#include <QSet>
+#include <QVector>
+#include <QtEndian>
+
+#include <cstring>
+
+namespace {
+
+enum TiffTag {
+    TagNewSubfileType        = 0x00FE,
+    TagCompression           = 0x0103,
+    TagPhotometric           = 0x0106,
+    TagStripOffsets          = 0x0111,
+    TagOrientation           = 0x0112,
+    TagStripByteCounts       = 0x0117,
+    TagSubIFDs               = 0x014A,
+    TagJpegInterchange       = 0x0201,
+    TagJpegInterchangeLength = 0x0202,
+    TagExifIFD               = 0x8769
+};
+
+// 用于防止损坏的文件中 IFD 互相引用导致死循环
+const int MaxIfdCount = 64;
+
+struct Candidate
+{
+    qint64 offset;
+    qint64 length;
+    QSize  size;
+};
+
+class TiffParser
+{
+public:
+    TiffParser(QIODevice *device, qint64 base)
+        : m_device(device)
+        , m_base(base)
+    {
+    }
+
+    bool parse()
+    {
+        uchar header[8];
+        if (!readAt(0, header, sizeof(header))) {
+            return false;
+        }
+        if (header[0] == 'I' && header[1] == 'I') {
+            m_littleEndian = true;
+        } else if (header[0] == 'M' && header[1] == 'M') {
+            m_littleEndian = false;
+        } else {
+            return false;
+        }
+        if (u16(header + 2) != 42) {
+            return false;
+        }
+
+        // IFD0 及其后续的 IFD(通常 IFD1 是缩略图)
+        quint32 offset = u32(header + 4);
+        bool first = true;
+        while (offset != 0 && m_visited.count() < MaxIfdCount) {
+            offset = parseIfd(offset, first);
+            first = false;
+        }
+        return true;
+    }
+
+    QVector<Candidate> candidates;
+    int orientation = 1;
+
+private:
+    // 返回下一个 IFD 的偏移
+    quint32 parseIfd(quint32 offset, bool isIfd0)
+    {
+        if (m_visited.contains(offset)) {
+            return 0;
+        }
+        m_visited.insert(offset);
+
+        uchar countBytes[2];
+        if (!readAt(offset, countBytes, 2)) {
+            return 0;
+        }
+        const int count = u16(countBytes);
+        QByteArray entries(count * 12 + 4, Qt::Uninitialized);
+        uchar *data = reinterpret_cast<uchar *>(entries.data());
+        if (!readAt(offset + 2, data, entries.size())) {
+            return 0;
+        }
+
+        int compression = 0;
+        int photometric = -1;
+        qint64 stripOffset = -1, stripLength = -1;
+        qint64 jpegOffset = -1, jpegLength = -1;
+        QVector<quint32> children;
+
+        for (int i = 0; i < count; i++) {
+            const uchar *entry = data + i * 12;
+            const quint16 tag = u16(entry);
+            const quint16 type = u16(entry + 2);
+            const quint32 valueCount = u32(entry + 4);
+            // SHORT 和 LONG 的单个值保存在条目内
+            const quint32 value = type == 3 ? u16(entry + 8) : u32(entry + 8);
+
+            switch (tag) {
+            case TagCompression:
+                compression = static_cast<int>(value);
+                break;
+            case TagPhotometric:
+                photometric = static_cast<int>(value);
+                break;
+            case TagOrientation:
+                if (isIfd0 && value >= 1 && value <= 8) {
+                    orientation = static_cast<int>(value);
+                }
+                break;
+            case TagStripOffsets:
+                if (valueCount == 1) {
+                    stripOffset = value;
+                }
+                break;
+            case TagStripByteCounts:
+                if (valueCount == 1) {
+                    stripLength = value;
+                }
+                break;
+            case TagJpegInterchange:
+                jpegOffset = value;
+                break;
+            case TagJpegInterchangeLength:
+                jpegLength = value;
+                break;
+            case TagSubIFDs:
+                children += readOffsets(type, valueCount, entry + 8);
+                break;
+            case TagExifIFD:
+                children.append(value);
+                break;
+            default:
+                break;
+            }
+        }
+
+        if (jpegOffset > 0 && jpegLength > 0) {
+            candidates.append(Candidate { m_base + jpegOffset, jpegLength, QSize() });
+        }
+        // 6 为旧式 JPEG，7 为 JPEG；CFA(32803)和 LinearRaw(34892)是原始数据，不是预览图
+        if ((compression == 6 || compression == 7) && photometric != 32803 && photometric != 34892
+                && stripOffset > 0 && stripLength > 0) {
+            candidates.append(Candidate { m_base + stripOffset, stripLength, QSize() });
+        }
+
+        for (quint32 child : children) {
+            if (m_visited.count() >= MaxIfdCount) {
+                break;
+            }
+            parseIfd(child, false);
+        }
+
+        return u32(data + count * 12);
+    }
+
+    QVector<quint32> readOffsets(quint16 type, quint32 count, const uchar *valueField)
+    {
+        QVector<quint32> offsets;
+        if (type != 4 && type != 13) {
+            return offsets;
+        }
+        count = qMin<quint32>(count, MaxIfdCount);
+        if (count == 1) {
+            offsets.append(u32(valueField));
+            return offsets;
+        }
+
+        QByteArray values(static_cast<int>(count) * 4, Qt::Uninitialized);
+        if (readAt(u32(valueField), reinterpret_cast<uchar *>(values.data()), values.size())) {
+            for (quint32 i = 0; i < count; i++) {
+                offsets.append(u32(reinterpret_cast<const uchar *>(values.constData()) + i * 4));
+            }
+        }
+        return offsets;
+    }
+
+    bool readAt(qint64 offset, uchar *data, qint64 size)
+    {
+        return m_device->seek(m_base + offset)
+                && m_device->read(reinterpret_cast<char *>(data), size) == size;
+    }
+
+    quint16 u16(const uchar *data) const
+    {
+        return m_littleEndian ? qFromLittleEndian<quint16>(data) : qFromBigEndian<quint16>(data);
+    }
+
+    quint32 u32(const uchar *data) const
+    {
+        return m_littleEndian ? qFromLittleEndian<quint32>(data) : qFromBigEndian<quint32>(data);
+    }
+
+    QIODevice *m_device;
+    qint64 m_base;
+    bool m_littleEndian = true;
+    QSet<quint32> m_visited;
+};
+
+// 沿着 JPEG 的段结构找到 SOF，只读取各段的头部；exifBase 返回 EXIF 中 TIFF 数据的位置
+// 无损 JPEG(RAW 中的传感器数据常用这种编码)Qt 无法解码，返回无效尺寸
+QSize scanJpeg(QIODevice *device, qint64 offset, qint64 *exifBase = nullptr)
+{
+    uchar marker[4];
+    if (!device->seek(offset) || device->read(reinterpret_cast<char *>(marker), 2) != 2
+            || marker[0] != 0xFF || marker[1] != 0xD8) {
+        return QSize();
+    }
+
+    qint64 pos = offset + 2;
+    while (device->seek(pos) && device->read(reinterpret_cast<char *>(marker), 4) == 4) {
+        if (marker[0] != 0xFF) {
+            break;
+        }
+        if (marker[1] == 0xFF) {
+            // 填充字节
+            pos++;
+            continue;
+        }
+
+        const uchar type = marker[1];
+        const int length = qFromBigEndian<quint16>(marker + 2);
+        if (type == 0xD9 || type == 0xDA || length < 2) {
+            break;
+        }
+
+        if (type == 0xE1 && exifBase && *exifBase < 0) {
+            char signature[6];
+            if (device->read(signature, 6) == 6 && memcmp(signature, "Exif\0\0", 6) == 0) {
+                *exifBase = pos + 10;
+            }
+        }
+
+        if (type >= 0xC0 && type <= 0xCF && type != 0xC4 && type != 0xC8 && type != 0xCC) {
+            if (type == 0xC3 || type == 0xC7 || type == 0xCB || type == 0xCF) {
+                break;
+            }
+            uchar sof[5];
+            if (device->seek(pos + 4) && device->read(reinterpret_cast<char *>(sof), 5) == 5) {
+                return QSize(qFromBigEndian<quint16>(sof + 3), qFromBigEndian<quint16>(sof + 1));
+            }
+            break;
+        }
+
+        pos += 2 + length;
+    }
+
+    return QSize();
+}
+
+QSize orientedSize(const QSize &size, int orientation)
+{
+    return orientation >= 5 ? size.transposed() : size;
+}
+
+} // namespace
+
+EmbeddedPreview::Preview EmbeddedPreview::read(const QString &filePath, Choice choice)
+{
+    Preview preview;
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return preview;
+    }
+
+    uchar magic[2];
+    if (file.read(reinterpret_cast<char *>(magic), 2) != 2) {
+        return preview;
+    }
+
+    qint64 tiffBase = -1;
+    QSize mainSize;
+    const bool isJpeg = magic[0] == 0xFF && magic[1] == 0xD8;
+    if (isJpeg) {
+        mainSize = scanJpeg(&file, 0, &tiffBase);
+        if (tiffBase < 0) {
+            return preview;
+        }
+    } else {
+        tiffBase = 0;
+    }
+
+    TiffParser parser(&file, tiffBase);
+    if (!parser.parse()) {
+        return preview;
+    }
+
+    // 只保留完整位于文件内、并且 Qt 可以解码的 JPEG 预览图
+    QVector<Candidate> candidates;
+    for (Candidate candidate : parser.candidates) {
+        if (candidate.offset + candidate.length > file.size()) {
+            continue;
+        }
+        candidate.size = scanJpeg(&file, candidate.offset);
+        if (candidate.size.isValid()) {
+            candidates.append(candidate);
+        }
+    }
+    if (candidates.isEmpty()) {
+        return preview;
+    }
+
+    const Candidate *smallest = &candidates.first();
+    const Candidate *largest = &candidates.first();
+    for (const Candidate &candidate : candidates) {
+        const qint64 pixels = qint64(candidate.size.width()) * candidate.size.height();
+        if (pixels < qint64(smallest->size.width()) * smallest->size.height()) {
+            smallest = &candidate;
+        }
+        if (pixels > qint64(largest->size.width()) * largest->size.height()) {
+            largest = &candidate;
+        }
+    }
+
+    if (!isJpeg) {
+        mainSize = largest->size;
+    }
+
+    const Candidate *chosen = choice == LargestPreview ? largest : smallest;
+    if (!file.seek(chosen->offset)) {
+        return preview;
+    }
+    preview.jpeg = file.read(chosen->length);
+    preview.orientation = parser.orientation;
+    preview.fullSize = orientedSize(mainSize, parser.orientation);
+
+    return preview;
+}
+
+QImage EmbeddedPreview::decode(const Preview &preview, const QSize &boundingSize)
+{
+    QBuffer buffer;
+    buffer.setData(preview.jpeg);
+    buffer.open(QIODevice::ReadOnly);
+
+    // 方向由外层文件决定，内嵌的预览图一般没有自己的 EXIF
+    QImageReader reader(&buffer, "jpeg");
+    reader.setAutoTransform(false);
+
+    const bool rotate90 = preview.orientation >= 5;
+    if (boundingSize.isValid()) {
+        QSize size = reader.size();
+        const QSize bound = rotate90 ? boundingSize.transposed() : boundingSize;
+        if (size.isValid() && (size.width() > bound.width() || size.height() > bound.height())) {
+            size.scale(bound, Qt::KeepAspectRatio);
+            reader.setScaledSize(size);
+        }
+    }
+
+    QImage image = reader.read();
+    if (image.isNull()) {
+        return image;
+    }
+
+    // 与 QImageIOHandler 的处理顺序一致：先镜像，再旋转 90 度
+    const int o = preview.orientation;
+    const bool mirror = o == 2 || o == 3 || o == 7 || o == 8;
+    const bool flip = o == 3 || o == 4 || o == 5 || o == 8;
+    if (mirror || flip) {
+        image = image.mirrored(mirror, flip);
+    }
+    if (rotate90) {
+        image = image.transformed(QTransform().rotate(90));
+    }
+
+    return image;
+}
+
+bool EmbeddedPreview::isRawSuffix(const QString &suffix)
+{
+    static const QSet<QString> rawSuffixes {
+        QStringLiteral("cr2"), QStringLiteral("nef"), QStringLiteral("nrw"),
+        QStringLiteral("arw"), QStringLiteral("srf"), QStringLiteral("sr2"), QStringLiteral("dng")
+    };
+    return rawSuffixes.contains(suffix.toLower());
+}
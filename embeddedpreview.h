@@ -0,0 +1,38 @@
+#ifndef EMBEDDEDPREVIEW_H
+#define EMBEDDEDPREVIEW_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QSize>
+#include <QString>
+
+/**
+ * @brief 读取相机 RAW(CR2、NEF、ARW、DNG)和 JPEG 文件中内嵌的 JPEG 预览图
+ *
+ * 只解析 TIFF/EXIF 的 IFD 结构，按需读取用到的字节，不读取原始的传感器数据。
+ */
+class EmbeddedPreview
+{
+public:
+    enum Choice {
+        LargestPreview,  // 用于显示
+        SmallestPreview  // 用于在解码完成之前立即显示
+    };
+
+    struct Preview
+    {
+        QByteArray jpeg;
+        QSize      fullSize;        // 文件中最大的图像(JPEG 文件即主图)的尺寸，已按方向旋转
+        int        orientation = 1; // EXIF 方向
+
+        bool isValid() const { return !jpeg.isEmpty(); }
+    };
+
+    static Preview read(const QString &filePath, Choice choice = LargestPreview);
+    // boundingSize 有效时以不超过该尺寸的大小解码
+    static QImage decode(const Preview &preview, const QSize &boundingSize = QSize());
+
+    static bool isRawSuffix(const QString &suffix);
+};
+
+#endif // EMBEDDEDPREVIEW_H
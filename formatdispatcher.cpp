@@ -0,0 +1,194 @@
+#include "formatdispatcher.h"
+
+#include "embeddedpreview.h"
+#include "pipelinestats.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QMutexLocker>
+
+#include <cctype>
+#include <cstring>
+
+namespace {
+
+typedef ImageEngine (*RefineFunc)(const QByteArray &header);
+
+struct MagicEntry
+{
+    int         offset;
+    const char *magic;
+    int         length;
+    const char *format;
+    ImageEngine engine;
+    RefineFunc  refine;
+};
+
+// 扩展格式(VP8X)中带有动画标记的 WebP 交给 QMovie 播放
+ImageEngine refineWebP(const QByteArray &header)
+{
+    if (header.size() > 20 && header.mid(12, 4) == "VP8X"
+            && (static_cast<uchar>(header.at(20)) & 0x02)) {
+        return EngineAnimated;
+    }
+    return EngineStill;
+}
+
+const MagicEntry magicTable[] = {
+    { 0, "\x89PNG\r\n\x1a\n",            8,  "png",  EngineStill,    nullptr    },
+    { 0, "\xff\xd8\xff",                 3,  "jpeg", EngineStill,    nullptr    },
+    { 0, "GIF87a",                       6,  "gif",  EngineAnimated, nullptr    },
+    { 0, "GIF89a",                       6,  "gif",  EngineAnimated, nullptr    },
+    { 8, "WEBPVP8",                      7,  "webp", EngineStill,    refineWebP },
+    { 0, "BM",                           2,  "bmp",  EngineStill,    nullptr    },
+    { 0, "II*\0",                        4,  "tiff", EngineStill,    nullptr    },
+    { 0, "MM\0*",                        4,  "tiff", EngineStill,    nullptr    },
+    { 0, "\0\0\1\0",                     4,  "ico",  EngineStill,    nullptr    },
+    { 0, "\0\0\2\0",                     4,  "cur",  EngineStill,    nullptr    },
+    { 4, "ftypavif",                     8,  "avif", EngineStill,    nullptr    },
+    { 4, "ftypavis",                     8,  "avif", EngineAnimated, nullptr    },
+    { 4, "ftypheic",                     8,  "heif", EngineStill,    nullptr    },
+    { 4, "ftypheix",                     8,  "heif", EngineStill,    nullptr    },
+    { 4, "ftypmif1",                     8,  "heif", EngineStill,    nullptr    },
+    { 0, "\0\0\0\x0cjP  \r\n\x87\n",     12, "jp2",  EngineStill,    nullptr    },
+    { 0, "\0\0\0\x0cJXL \r\n\x87\n",     12, "jxl",  EngineStill,    nullptr    },
+    { 0, "\xff\x0a",                     2,  "jxl",  EngineStill,    nullptr    },
+    { 0, "8BPS",                         4,  "psd",  EngineStill,    nullptr    },
+    { 0, "DDS ",                         4,  "dds",  EngineStill,    nullptr    },
+    { 0, "\x76\x2f\x31\x01",             4,  "exr",  EngineStill,    nullptr    },
+    { 0, "/* XPM */",                    9,  "xpm",  EngineStill,    nullptr    },
+    { 0, "P1",                           2,  "pbm",  EngineStill,    nullptr    },
+    { 0, "P4",                           2,  "pbm",  EngineStill,    nullptr    },
+    { 0, "P2",                           2,  "pgm",  EngineStill,    nullptr    },
+    { 0, "P5",                           2,  "pgm",  EngineStill,    nullptr    },
+    { 0, "P3",                           2,  "ppm",  EngineStill,    nullptr    },
+    { 0, "P6",                           2,  "ppm",  EngineStill,    nullptr    },
+};
+
+bool looksLikeSvg(const QByteArray &header)
+{
+    int start = header.startsWith("\xef\xbb\xbf") ? 3 : 0;
+    while (start < header.size() && isspace(static_cast<uchar>(header.at(start)))) {
+        start++;
+    }
+
+    if (start >= header.size() || header.at(start) != '<') {
+        return false;
+    }
+
+    return header.indexOf("<svg", start) >= 0;
+}
+
+} // namespace
+
+FormatDispatcher *FormatDispatcher::instance()
+{
+    static FormatDispatcher dispatcher;
+    return &dispatcher;
+}
+
+SniffResult FormatDispatcher::sniff(const QString &filePath)
+{
+    QFileInfo info(filePath);
+    SniffResult result;
+    if (lookup(filePath, info.size(), info.lastModified(), result)) {
+        return result;
+    }
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return result;
+    }
+
+    return sniffAndStore(filePath, info.size(), info.lastModified(), file.read(HeaderSize));
+}
+
+SniffResult FormatDispatcher::sniff(const QString &filePath, const QByteArray &header)
+{
+    QFileInfo info(filePath);
+    SniffResult result;
+    if (lookup(filePath, info.size(), info.lastModified(), result)) {
+        return result;
+    }
+
+    return sniffAndStore(filePath, info.size(), info.lastModified(), header.left(HeaderSize));
+}
+
+SniffResult FormatDispatcher::sniffHeader(const QByteArray &header, const QString &suffix)
+{
+    SniffResult result;
+
+    for (const MagicEntry &entry : magicTable) {
+        if (header.size() < entry.offset + entry.length) {
+            continue;
+        }
+        if (memcmp(header.constData() + entry.offset, entry.magic, static_cast<size_t>(entry.length)) == 0) {
+            result.format = entry.format;
+            result.engine = entry.refine ? entry.refine(header) : entry.engine;
+            // 相机 RAW 文件也是 TIFF 结构，只显示其中内嵌的 JPEG 预览图
+            if (result.format == "tiff" && EmbeddedPreview::isRawSuffix(suffix)) {
+                result.format = "raw";
+            }
+            return result;
+        }
+    }
+
+    if (looksLikeSvg(header)) {
+        result.format = "svg";
+        result.engine = EngineVector;
+    } else if (header.startsWith("\x1f\x8b") && suffix.compare("svgz", Qt::CaseInsensitive) == 0) {
+        // gzip 压缩的内容只能依靠后缀判断
+        result.format = "svgz";
+        result.engine = EngineVector;
+    }
+
+    return result;
+}
+
+void FormatDispatcher::invalidate(const QString &filePath)
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.remove(filePath);
+}
+
+void FormatDispatcher::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.clear();
+}
+
+bool FormatDispatcher::lookup(const QString &filePath, qint64 size, const QDateTime &lastModified, SniffResult &result)
+{
+    QMutexLocker locker(&m_mutex);
+    QHash<QString, CacheEntry>::const_iterator it = m_cache.constFind(filePath);
+    const bool hit = it != m_cache.constEnd() && it->size == size && it->lastModified == lastModified;
+    PipelineStats::instance()->recordCacheLookup(PipelineStats::FormatCache, hit);
+    if (!hit) {
+        return false;
+    }
+
+    result = it->result;
+    return true;
+}
+
+SniffResult FormatDispatcher::sniffAndStore(const QString &filePath, qint64 size, const QDateTime &lastModified,
+                                            const QByteArray &header)
+{
+    SniffResult result = sniffHeader(header, QFileInfo(filePath).suffix());
+
+    if (!result.isValid()) {
+        // 表中没有的格式(如 kimageformats 提供的插件)才逐个插件探测，结果同样会被缓存
+        QImageReader reader(filePath);
+        reader.setDecideFormatFromContent(true);
+        if (reader.canRead()) {
+            result.format = reader.format();
+            result.engine = reader.supportsAnimation() ? EngineAnimated : EngineStill;
+        }
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_cache.insert(filePath, CacheEntry { result, size, lastModified });
+
+    return result;
+}
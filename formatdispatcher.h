@@ -0,0 +1,63 @@
+#ifndef FORMATDISPATCHER_H
+#define FORMATDISPATCHER_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+enum ImageEngine {
+    EngineUnknown,
+    EngineStill,    // QImageReader
+    EngineAnimated, // QMovie
+    EngineVector    // QGraphicsSvgItem
+};
+
+struct SniffResult
+{
+    QByteArray  format;               // Qt 图片格式名，如 "png"；相机 RAW 文件为 "raw"
+    ImageEngine engine = EngineUnknown;
+
+    bool isValid() const { return engine != EngineUnknown; }
+};
+
+/**
+ * @brief 根据文件头部字节(magic number)判断图片格式，并选择对应的显示引擎
+ *
+ * 结果按文件路径缓存(以文件大小和修改时间校验)，图库中来回切换时无需再次探测。
+ */
+class FormatDispatcher
+{
+public:
+    static FormatDispatcher *instance();
+
+    static const int HeaderSize = 1024;
+
+    SniffResult sniff(const QString &filePath);
+    // 调用方已经读取(或映射)了文件头部时使用，避免重复读取
+    SniffResult sniff(const QString &filePath, const QByteArray &header);
+
+    static SniffResult sniffHeader(const QByteArray &header, const QString &suffix = QString());
+
+    void invalidate(const QString &filePath);
+    void clear();
+
+private:
+    FormatDispatcher() = default;
+
+    struct CacheEntry {
+        SniffResult result;
+        qint64      size;
+        QDateTime   lastModified;
+    };
+
+    bool lookup(const QString &filePath, qint64 size, const QDateTime &lastModified, SniffResult &result);
+    SniffResult sniffAndStore(const QString &filePath, qint64 size, const QDateTime &lastModified,
+                              const QByteArray &header);
+
+    QHash<QString, CacheEntry> m_cache;
+    QMutex m_mutex;
+};
+
+#endif // FORMATDISPATCHER_H
@@ -0,0 +1,269 @@
+#include "glviewport.h"
+
+#include "pipelinestats.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QGraphicsView>
+#include <QMatrix4x4>
+#include <QOpenGLContext>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+#include <QPaintEngine>
+#include <QPainter>
+
+namespace {
+
+const char *VertexShader =
+        "attribute highp vec2 vertex;\n"
+        "attribute highp vec2 texCoord;\n"
+        "uniform highp mat4 matrix;\n"
+        "varying highp vec2 coord;\n"
+        "void main()\n"
+        "{\n"
+        "    coord = texCoord;\n"
+        "    gl_Position = matrix * vec4(vertex, 0.0, 1.0);\n"
+        "}\n";
+
+// 纹理不是预乘的，输出预乘的颜色以便与半透明窗口混合
+const char *FragmentShader =
+        "uniform sampler2D image;\n"
+        "uniform lowp float opacity;\n"
+        "varying highp vec2 coord;\n"
+        "void main()\n"
+        "{\n"
+        "    lowp vec4 color = texture2D(image, coord);\n"
+        "    gl_FragColor = vec4(color.rgb * color.a, color.a) * opacity;\n"
+        "}\n";
+
+bool isPowerOfTwo(int value)
+{
+    return value > 0 && (value & (value - 1)) == 0;
+}
+
+} // namespace
+
+GLViewport::GLViewport(QWidget *parent)
+    : QOpenGLWidget(parent)
+{
+    // 窗口是半透明的，帧缓冲区需要 alpha 通道
+    QSurfaceFormat surfaceFormat(format());
+    surfaceFormat.setAlphaBufferSize(8);
+    setFormat(surfaceFormat);
+}
+
+GLViewport::~GLViewport()
+{
+    if (m_initialized) {
+        // 基类析构时上下文才被销毁，那时不能再调用这里的成员
+        disconnect(context(), nullptr, this, nullptr);
+        makeCurrent();
+        releaseResources();
+        doneCurrent();
+    }
+}
+
+bool GLViewport::isAvailable()
+{
+    static const bool available = []() {
+        QOpenGLContext context;
+        return context.create();
+    }();
+    return available;
+}
+
+bool GLViewport::install(QGraphicsView *view, bool enabled)
+{
+    const bool installed = qobject_cast<GLViewport *>(view->viewport()) != nullptr;
+    enabled = enabled && isAvailable();
+    if (enabled == installed) {
+        return installed;
+    }
+
+    view->setViewport(enabled ? new GLViewport : new QWidget);
+    // OpenGL 视口每帧都会重绘整个帧缓冲区，只更新部分区域没有好处
+    view->setViewportUpdateMode(enabled ? QGraphicsView::FullViewportUpdate : QGraphicsView::MinimalViewportUpdate);
+    return enabled;
+}
+
+bool GLViewport::drawPixmap(QPainter *painter, const QRectF &target, const QPixmap &pixmap,
+                            Qt::TransformationMode mode, const QRectF &exposed)
+{
+    if (pixmap.isNull() || painter->paintEngine()->type() != QPaintEngine::OpenGL2
+            || QOpenGLContext::currentContext() != context() || !ensureInitialized()) {
+        return false;
+    }
+
+    const TileSet &tileSet = tilesFor(pixmap);
+    if (tileSet.tiles.isEmpty()) {
+        return false;
+    }
+
+    // 项坐标 -> 视口坐标 -> 裁剪坐标，视口坐标的 y 轴向下
+    QMatrix4x4 matrix;
+    matrix.ortho(rect());
+    matrix *= QMatrix4x4(painter->combinedTransform());
+
+    const qreal scaleX = target.width() / pixmap.width();
+    const qreal scaleY = target.height() / pixmap.height();
+    const GLfloat texCoords[] = { 0, 0, 1, 0, 0, 1, 1, 1 };
+
+    painter->beginNativePainting();
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glActiveTexture(GL_TEXTURE0);
+
+    m_program->bind();
+    m_program->setUniformValue("matrix", matrix);
+    m_program->setUniformValue("opacity", GLfloat(painter->opacity()));
+    m_program->setUniformValue("image", 0);
+    m_program->enableAttributeArray("vertex");
+    m_program->enableAttributeArray("texCoord");
+    m_program->setAttributeArray("texCoord", texCoords, 2);
+
+    for (const Tile &tile : tileSet.tiles) {
+        const QRectF tileTarget(target.left() + tile.rect.left() * scaleX, target.top() + tile.rect.top() * scaleY,
+                                tile.rect.width() * scaleX, tile.rect.height() * scaleY);
+        if (!tileTarget.intersects(exposed)) {
+            continue;
+        }
+
+        const GLfloat vertices[] = {
+            GLfloat(tileTarget.left()), GLfloat(tileTarget.top()),
+            GLfloat(tileTarget.right()), GLfloat(tileTarget.top()),
+            GLfloat(tileTarget.left()), GLfloat(tileTarget.bottom()),
+            GLfloat(tileTarget.right()), GLfloat(tileTarget.bottom())
+        };
+        m_program->setAttributeArray("vertex", vertices, 2);
+
+        // 缩小时总是使用 mipmap，放大时与光栅绘制一样区分平滑和最近邻
+        tile.texture->setMagnificationFilter(mode == Qt::SmoothTransformation ? QOpenGLTexture::Linear
+                                                                              : QOpenGLTexture::Nearest);
+        tile.texture->bind();
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        tile.texture->release();
+    }
+
+    m_program->disableAttributeArray("vertex");
+    m_program->disableAttributeArray("texCoord");
+    m_program->release();
+    painter->endNativePainting();
+    return true;
+}
+
+bool GLViewport::ensureInitialized()
+{
+    if (m_initialized) {
+        return m_program != nullptr;
+    }
+    m_initialized = true;
+
+    initializeOpenGLFunctions();
+    // 上下文在视口移动到其它窗口时会重新创建
+    connect(context(), &QOpenGLContext::aboutToBeDestroyed, this, [this]() {
+        makeCurrent();
+        releaseResources();
+        doneCurrent();
+    });
+
+    QOpenGLContext *glContext = context();
+    m_npotMipmaps = !glContext->isOpenGLES() || glContext->format().majorVersion() >= 3
+            || glContext->hasExtension(QByteArrayLiteral("GL_OES_texture_npot"));
+
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    if (maxTextureSize > 0) {
+        m_tileSize = qMin(m_tileSize, int(maxTextureSize));
+    }
+
+    m_program = new QOpenGLShaderProgram;
+    if (!m_program->addShaderFromSourceCode(QOpenGLShader::Vertex, VertexShader)
+            || !m_program->addShaderFromSourceCode(QOpenGLShader::Fragment, FragmentShader)
+            || !m_program->link()) {
+        qWarning() << "Cannot build the OpenGL viewport shader:" << m_program->log();
+        delete m_program;
+        m_program = nullptr;
+    }
+    return m_program != nullptr;
+}
+
+const GLViewport::TileSet &GLViewport::tilesFor(const QPixmap &pixmap)
+{
+    const qint64 key = pixmap.cacheKey();
+    QHash<qint64, TileSet>::iterator it = m_tileSets.find(key);
+    if (it != m_tileSets.end()) {
+        it->lastUsed = ++m_useCounter;
+        return *it;
+    }
+
+    // 淘汰最久没有绘制的图片
+    while (m_tileSets.count() >= MaxTileSets) {
+        QHash<qint64, TileSet>::iterator oldest = m_tileSets.begin();
+        for (QHash<qint64, TileSet>::iterator candidate = m_tileSets.begin(); candidate != m_tileSets.end(); ++candidate) {
+            if (candidate->lastUsed < oldest->lastUsed) {
+                oldest = candidate;
+            }
+        }
+        releaseTiles(*oldest);
+        m_tileSets.erase(oldest);
+        updateMemoryUsage();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    TileSet tileSet;
+    tileSet.lastUsed = ++m_useCounter;
+    const QImage image(pixmap.toImage());
+    for (int y = 0; y < image.height(); y += m_tileSize) {
+        for (int x = 0; x < image.width(); x += m_tileSize) {
+            const QRect tileRect(x, y, qMin(m_tileSize, image.width() - x), qMin(m_tileSize, image.height() - y));
+            // 边缘的块通常不是 2 的幂，不支持时这些块缩小时只做线性过滤
+            const bool mipmaps = m_npotMipmaps || (isPowerOfTwo(tileRect.width()) && isPowerOfTwo(tileRect.height()));
+            QOpenGLTexture *texture = new QOpenGLTexture(image.copy(tileRect), mipmaps ? QOpenGLTexture::GenerateMipMaps
+                                                                                       : QOpenGLTexture::DontGenerateMipMaps);
+            texture->setMinificationFilter(mipmaps ? QOpenGLTexture::LinearMipMapLinear : QOpenGLTexture::Linear);
+            // 块的边缘不与相邻块的像素混合
+            texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+            tileSet.tiles.append(Tile { tileRect, texture });
+
+            // RGBA8，mipmap 约多占三分之一
+            const qint64 bytes = qint64(tileRect.width()) * tileRect.height() * 4;
+            tileSet.bytes += mipmaps ? bytes * 4 / 3 : bytes;
+        }
+    }
+
+    PipelineStats::instance()->recordUpload(timer.nsecsElapsed() / 1000);
+    const TileSet &inserted = *m_tileSets.insert(key, tileSet);
+    updateMemoryUsage();
+    return inserted;
+}
+
+void GLViewport::releaseTiles(TileSet &tileSet)
+{
+    for (const Tile &tile : qAsConst(tileSet.tiles)) {
+        delete tile.texture;
+    }
+    tileSet.tiles.clear();
+}
+
+void GLViewport::releaseResources()
+{
+    for (TileSet &tileSet : m_tileSets) {
+        releaseTiles(tileSet);
+    }
+    m_tileSets.clear();
+    updateMemoryUsage();
+    delete m_program;
+    m_program = nullptr;
+    m_initialized = false;
+}
+
+void GLViewport::updateMemoryUsage()
+{
+    qint64 bytes = 0;
+    for (const TileSet &tileSet : qAsConst(m_tileSets)) {
+        bytes += tileSet.bytes;
+    }
+    m_memory.setBytes(bytes);
+}
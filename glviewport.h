@@ -0,0 +1,74 @@
+#ifndef GLVIEWPORT_H
+#define GLVIEWPORT_H
+
+#include "imagememory.h"
+
+#include <QHash>
+#include <QOpenGLFunctions>
+#include <QOpenGLWidget>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+class QGraphicsView;
+class QOpenGLShaderProgram;
+class QOpenGLTexture;
+QT_END_NAMESPACE
+
+/**
+ * @brief 可选的 OpenGL 视口，用于 GraphicsView 和 NavigatorView
+ *
+ * 图片第一次绘制时按块上传为带 mipmap 的纹理，之后的平移、缩放和旋转只改变绘制时的变换矩阵，
+ * 不再由 CPU 缩放像素。只使用 OpenGL 2.0 / ES 2.0 的功能，没有 GPU 时也可以在 Mesa 的
+ * llvmpipe 上运行。
+ */
+class GLViewport : public QOpenGLWidget, protected QOpenGLFunctions
+{
+    Q_OBJECT
+public:
+    explicit GLViewport(QWidget *parent = nullptr);
+    ~GLViewport() override;
+
+    // 是否能创建 OpenGL 上下文，结果在第一次调用后缓存
+    static bool isAvailable();
+    // 切换 view 的视口，返回切换后是否使用 OpenGL
+    static bool install(QGraphicsView *view, bool enabled);
+
+    // 用纹理把 pixmap 绘制到 painter 当前坐标系中的 target，只绘制与 exposed 相交的块。
+    // painter 不是 OpenGL 绘制引擎时返回 false，由调用方按普通方式绘制
+    bool drawPixmap(QPainter *painter, const QRectF &target, const QPixmap &pixmap,
+                    Qt::TransformationMode mode, const QRectF &exposed);
+
+private:
+    struct Tile
+    {
+        QRect rect;     // 在 pixmap 中的位置
+        QOpenGLTexture *texture;
+    };
+
+    struct TileSet
+    {
+        QVector<Tile> tiles;
+        quint64 lastUsed = 0;
+        qint64 bytes = 0;
+    };
+
+    bool ensureInitialized();
+    const TileSet &tilesFor(const QPixmap &pixmap);
+    void releaseTiles(TileSet &tileSet);
+    void releaseResources();
+    void updateMemoryUsage();
+
+    // 最多保留几张图片的纹理(当前图片和局部图，以及刚切换走的图片)
+    static const int MaxTileSets = 4;
+
+    QHash<qint64, TileSet> m_tileSets;
+    quint64 m_useCounter = 0;
+    QOpenGLShaderProgram *m_program = nullptr;
+    int m_tileSize = 1024;
+    // OpenGL ES 2.0 没有 GL_OES_texture_npot 时，尺寸不是 2 的幂的纹理不能使用 mipmap
+    bool m_npotMipmaps = true;
+    bool m_initialized = false;
+    ImageMemoryTicket m_memory { ImageMemory::Texture };
+};
+
+#endif // GLVIEWPORT_H
@@ -1,5 +1,8 @@
 #include "graphicsscene.h"
 
+#include "imagememory.h"
+#include "pixmapitem.h"
+
 #include <QGraphicsSceneMouseEvent>
 #include <QMimeData>
 #include <QDebug>
@@ -23,40 +26,62 @@ GraphicsScene::~GraphicsScene()
 
 void GraphicsScene::showImage(const QPixmap &pixmap)
 {
-    this->clear();
-    QGraphicsPixmapItem * pixmapItem = this->addPixmap(pixmap);
-    pixmapItem->setShapeMode(QGraphicsPixmapItem::BoundingRectShape);
+    clearAll();
+    PixmapItem *pixmapItem = new PixmapItem(pixmap);
+    this->addItem(pixmapItem);
     m_theThing = pixmapItem;
     this->setSceneRect(m_theThing->boundingRect());
+
+    m_memory.reset(ImageMemory::bytesOf(pixmap));
+}
+
+void GraphicsScene::showImage(const QPixmap &overview, const QSize &fullSize)
+{
+    showImage(overview);
+    if (overview.isNull() || !fullSize.isValid() || fullSize == overview.size()) {
+        return;
+    }
+
+    m_theThing->setTransform(QTransform::fromScale(qreal(fullSize.width()) / overview.width(),
+                                                   qreal(fullSize.height()) / overview.height()));
+    m_fullSize = fullSize;
+    this->setSceneRect(QRectF(QPointF(0, 0), fullSize));
 }
 
 void GraphicsScene::showText(const QString &text)
 {
-    this->clear();
+    clearAll();
     QGraphicsTextItem *textItem = this->addText(text);
     textItem->setDefaultTextColor(QColor("White"));
     m_theThing = textItem;
+    m_memory.reset();
     this->setSceneRect(m_theThing->boundingRect());
 }
 
 void GraphicsScene::showSvg(const QString &filepath)
 {
-    this->clear();
+    clearAll();
     QGraphicsSvgItem *svgItem = new QGraphicsSvgItem(filepath);
     this->addItem(svgItem);
     m_theThing = svgItem;
+    m_memory.reset();
     this->setSceneRect(m_theThing->boundingRect());
 }
 
-void GraphicsScene::showGif(const QString &filepath)
+void GraphicsScene::showGif(const QString &filepath, const QByteArray &format)
 {
-    this->clear();
-    QMovie *movie = new QMovie(filepath);
+    clearAll();
     QLabel *label = new QLabel;
+    // movie 随 label 一起由场景中的代理控件释放
+    QMovie *movie = new QMovie(filepath, format, label);
     label->setStyleSheet("background-color:rgba(225,255,255,0);");
     label->setMovie(movie);
     this->addWidget(label);
     movie->start();
+    // QMovie 保留当前帧的 QImage 和 QPixmap
+    m_memory.reset(ImageMemory::bytesOf(movie->currentImage()) * 2);
+    m_memory.attach(movie);
+    m_memory.attach(label);
     m_theThing = this->addRect(QRect(QPoint(0, 0), label->sizeHint()),
                                QPen(Qt::transparent));
     this->setSceneRect(m_theThing->boundingRect());
@@ -67,11 +92,40 @@ bool GraphicsScene::trySetTransformationMode(Qt::TransformationMode mode)
     QGraphicsPixmapItem *pixmapItem = qgraphicsitem_cast<QGraphicsPixmapItem *>(m_theThing);
     if (pixmapItem) {
         pixmapItem->setTransformationMode(mode);
+        if (m_detail) {
+            m_detail->setTransformationMode(mode);
+        }
+        if (m_overlay) {
+            m_overlay->setTransformationMode(mode);
+        }
         return true;
     }
     return false;
 }
 
+Qt::TransformationMode GraphicsScene::transformationMode() const
+{
+    QGraphicsPixmapItem *pixmapItem = qgraphicsitem_cast<QGraphicsPixmapItem *>(m_theThing);
+    return pixmapItem ? pixmapItem->transformationMode() : Qt::FastTransformation;
+}
+
+bool GraphicsScene::replacePixmap(const QPixmap &pixmap)
+{
+    // 只替换图像内容，保持场景大小和视图变换不变
+    QGraphicsPixmapItem *pixmapItem = qgraphicsitem_cast<QGraphicsPixmapItem *>(m_theThing);
+    if (pixmapItem && pixmapItem->pixmap().size() == pixmap.size()) {
+        pixmapItem->setPixmap(pixmap);
+        return true;
+    }
+    return false;
+}
+
+QPixmap GraphicsScene::currentPixmap() const
+{
+    QGraphicsPixmapItem *pixmapItem = qgraphicsitem_cast<QGraphicsPixmapItem *>(m_theThing);
+    return pixmapItem ? pixmapItem->pixmap() : QPixmap();
+}
+
 QPixmap GraphicsScene::renderToPixmap()
 {
     QPixmap pixmap(sceneRect().toRect().size());
@@ -79,3 +133,87 @@ QPixmap GraphicsScene::renderToPixmap()
     render(&p, sceneRect());
     return pixmap;
 }
+
+bool GraphicsScene::isOverview() const
+{
+    return m_fullSize.isValid();
+}
+
+qreal GraphicsScene::overviewScale() const
+{
+    QGraphicsPixmapItem *pixmapItem = qgraphicsitem_cast<QGraphicsPixmapItem *>(m_theThing);
+    if (!isOverview() || !pixmapItem) {
+        return 1;
+    }
+    return qreal(pixmapItem->pixmap().width()) / m_fullSize.width();
+}
+
+void GraphicsScene::showDetail(const QPixmap &pixmap, const QRect &region)
+{
+    if (!isOverview() || pixmap.isNull() || region.isEmpty()) {
+        return;
+    }
+
+    if (!m_detail) {
+        m_detail = new PixmapItem(pixmap);
+        this->addItem(m_detail);
+        m_detail->setTransformationMode(transformationMode());
+        // 显示在概览图之上
+        m_detail->setZValue(1);
+    } else {
+        m_detail->setPixmap(pixmap);
+    }
+    m_detail->setTransform(QTransform::fromScale(qreal(region.width()) / pixmap.width(),
+                                                 qreal(region.height()) / pixmap.height()));
+    m_detail->setPos(region.topLeft());
+    m_detailMemory.reset(ImageMemory::bytesOf(pixmap));
+}
+
+void GraphicsScene::clearDetail()
+{
+    if (m_detail) {
+        this->removeItem(m_detail);
+        delete m_detail;
+        m_detail = nullptr;
+    }
+    m_detailMemory.reset();
+}
+
+void GraphicsScene::showOverlay(const QPixmap &pixmap, const QRect &region)
+{
+    if (pixmap.isNull() || region.isEmpty()) {
+        clearOverlay();
+        return;
+    }
+
+    if (!m_overlay) {
+        m_overlay = new PixmapItem(pixmap);
+        this->addItem(m_overlay);
+        // 显示在局部图之上
+        m_overlay->setZValue(2);
+    } else {
+        m_overlay->setPixmap(pixmap);
+    }
+    m_overlay->setTransform(QTransform::fromScale(qreal(region.width()) / pixmap.width(),
+                                                  qreal(region.height()) / pixmap.height()));
+    m_overlay->setPos(region.topLeft());
+    m_overlayMemory.reset(ImageMemory::bytesOf(pixmap));
+}
+
+void GraphicsScene::clearOverlay()
+{
+    if (m_overlay) {
+        this->removeItem(m_overlay);
+        delete m_overlay;
+        m_overlay = nullptr;
+    }
+    m_overlayMemory.reset();
+}
+
+void GraphicsScene::clearAll()
+{
+    clearDetail();
+    clearOverlay();
+    this->clear();
+    m_fullSize = QSize();
+}
@@ -1,6 +1,8 @@
 #ifndef GRAPHICSSCENE_H
 #define GRAPHICSSCENE_H
 
+#include "imagememory.h"
+
 #include <QGraphicsScene>
 
 class GraphicsScene : public QGraphicsScene
@@ -11,16 +13,39 @@ public:
     ~GraphicsScene();
 
     void showImage(const QPixmap &pixmap);
+    // 很大的图片只显示缩小的概览图，场景坐标仍然是原图的像素坐标
+    void showImage(const QPixmap &overview, const QSize &fullSize);
     void showText(const QString &text);
     void showSvg(const QString &filepath);
-    void showGif(const QString &filepath);
+    void showGif(const QString &filepath, const QByteArray &format = QByteArray());
 
     bool trySetTransformationMode(Qt::TransformationMode mode);
+    Qt::TransformationMode transformationMode() const;
+    bool replacePixmap(const QPixmap &pixmap);
+    QPixmap currentPixmap() const;
 
     QPixmap renderToPixmap();
 
+    bool isOverview() const;
+    // 概览图相对原图的缩放比例，不是概览图时为 1
+    qreal overviewScale() const;
+    // 在概览图上叠加按需解码的局部图，region 为场景坐标
+    void showDetail(const QPixmap &pixmap, const QRect &region);
+    void clearDetail();
+    // 在图片之上叠加其它内容(如对比时的差异图)，region 为场景坐标
+    void showOverlay(const QPixmap &pixmap, const QRect &region);
+    void clearOverlay();
+
 private:
+    void clearAll();
+
     QGraphicsItem *m_theThing;
+    QGraphicsPixmapItem *m_detail = nullptr;
+    QGraphicsPixmapItem *m_overlay = nullptr;
+    QSize m_fullSize;
+    ImageMemoryTicket m_memory { ImageMemory::Scene };
+    ImageMemoryTicket m_detailMemory { ImageMemory::Scene };
+    ImageMemoryTicket m_overlayMemory { ImageMemory::Scene };
 };
 
 #endif // GRAPHICSSCENE_H
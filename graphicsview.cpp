@@ -1,15 +1,36 @@
 #include "graphicsview.h"
 
 #include "graphicsscene.h"
+#include "formatdispatcher.h"
+#include "glviewport.h"
+#include "imageloader.h"
+#include "imagememory.h"
+#include "pipelinestats.h"
+#include "regionloader.h"
 
 #include <QMouseEvent>
 #include <QDebug>
 #include <QScrollBar>
 #include <QMimeData>
-#include <QImageReader>
+#include <QElapsedTimer>
+#include <QPainter>
+#include <QTimer>
+#include <QFileInfo>
+#include <QtMath>
+
+namespace {
+
+// 视图状态变化通知的合并间隔，约为一帧
+const int FrameIntervalMs = 16;
+
+// 可见区域四周多解码的比例，小范围平移时不必重新解码
+const qreal DetailMargin = 0.25;
+
+} // namespace
 
 GraphicsView::GraphicsView(QWidget *parent)
     : QGraphicsView (parent)
+    , m_regionLoader(new RegionLoader(this))
 {
     // 设置拖拽为手形拖拽
     setDragMode(QGraphicsView::ScrollHandDrag);
@@ -23,29 +44,47 @@ GraphicsView::GraphicsView(QWidget *parent)
     setAcceptDrops(true);
     setCheckerboardEnabled(false);
 
-    connect(horizontalScrollBar(), &QScrollBar::valueChanged, this, &GraphicsView::viewportRectChanged);
-    connect(verticalScrollBar(), &QScrollBar::valueChanged, this, &GraphicsView::viewportRectChanged);
+    m_viewStateTimer.setSingleShot(true);
+    m_viewStateTimer.setInterval(FrameIntervalMs);
+    connect(&m_viewStateTimer, &QTimer::timeout, this, &GraphicsView::emitViewStateChanged);
+
+    connect(horizontalScrollBar(), &QScrollBar::valueChanged, this, &GraphicsView::scheduleViewStateUpdate);
+    connect(verticalScrollBar(), &QScrollBar::valueChanged, this, &GraphicsView::scheduleViewStateUpdate);
+
+    connect(m_regionLoader, &RegionLoader::regionReady, this, [this](const QRect &region, const QImage &image) {
+        QElapsedTimer timer;
+        timer.start();
+        const QPixmap pixmap(QPixmap::fromImage(image));
+        PipelineStats::instance()->recordUpload(timer.nsecsElapsed() / 1000);
+        scene()->showDetail(pixmap, region);
+    });
 }
 
 void GraphicsView::showFileFromUrl(const QUrl &url, bool doRequestGallery)
 {
-    emit navigatorViewRequired(false, 0);
-
     QString filePath(url.toLocalFile());
 
-    if (filePath.endsWith(".svg")) {
+    const SniffResult sniffed = FormatDispatcher::instance()->sniff(filePath);
+    switch (sniffed.engine) {
+    case EngineVector:
         showSvg(filePath);
-    } else if (filePath.endsWith(".gif")) {
-        showGif(filePath);
-    } else {
-       QImageReader imageReader(filePath);
-       imageReader.setAutoTransform(true);
-       imageReader.setDecideFormatFromContent(true);
-       if (imageReader.format().isEmpty()) {
-           showText(tr("File not is a valid image"));
-       } else {
-           showImage(QPixmap::fromImageReader(&imageReader));
-       }
+        break;
+    case EngineAnimated:
+        showGif(filePath, sniffed.format);
+        break;
+    case EngineStill: {
+        // 分开解码和转换为 QPixmap 两步，以便分别统计耗时
+        const QImage image(ImageLoader::decode(filePath));
+        if (image.isNull()) {
+            showText(tr("File not is a valid image"));
+        } else {
+            showImage(image);
+        }
+        break;
+    }
+    case EngineUnknown:
+        showText(tr("File not is a valid image"));
+        break;
     }
 
     if (doRequestGallery) {
@@ -55,6 +94,7 @@ void GraphicsView::showFileFromUrl(const QUrl &url, bool doRequestGallery)
 
 void GraphicsView::showImage(const QPixmap &pixmap)
 {
+    stopRegionDecoding();
     resetTransform();
     scene()->showImage(pixmap);
     checkAndDoFitInView();
@@ -62,13 +102,34 @@ void GraphicsView::showImage(const QPixmap &pixmap)
 
 void GraphicsView::showImage(const QImage &image)
 {
+    stopRegionDecoding();
     resetTransform();
-    scene()->showImage(QPixmap::fromImage(image));
+    QElapsedTimer timer;
+    timer.start();
+    const QPixmap pixmap(QPixmap::fromImage(image));
+    PipelineStats::instance()->recordUpload(timer.nsecsElapsed() / 1000);
+    scene()->showImage(pixmap);
+    checkAndDoFitInView();
+}
+
+void GraphicsView::showOverview(const QImage &overview, const QString &filePath, const QSize &fullSize)
+{
+    stopRegionDecoding();
+    resetTransform();
+    QElapsedTimer timer;
+    timer.start();
+    const QPixmap pixmap(QPixmap::fromImage(overview));
+    PipelineStats::instance()->recordUpload(timer.nsecsElapsed() / 1000);
+    scene()->showImage(pixmap, fullSize);
+    if (scene()->isOverview()) {
+        m_regionLoader->setFilePath(filePath);
+    }
     checkAndDoFitInView();
 }
 
 void GraphicsView::showText(const QString &text)
 {
+    stopRegionDecoding();
     resetTransform();
     scene()->showText(text);
     checkAndDoFitInView();
@@ -76,15 +137,17 @@ void GraphicsView::showText(const QString &text)
 
 void GraphicsView::showSvg(const QString &filepath)
 {
+    stopRegionDecoding();
     resetTransform();
     scene()->showSvg(filepath);
     checkAndDoFitInView();
 }
 
-void GraphicsView::showGif(const QString &filepath)
+void GraphicsView::showGif(const QString &filepath, const QByteArray &format)
 {
+    stopRegionDecoding();
     resetTransform();
-    scene()->showGif(filepath);
+    scene()->showGif(filepath, format);
     checkAndDoFitInView();
 }
 
@@ -108,10 +171,16 @@ qreal GraphicsView::scaleFactor() const
     }
 }
 
+qreal GraphicsView::rotateAngle() const
+{
+    return m_rotateAngle;
+}
+
 void GraphicsView::resetTransform()
 {
     m_rotateAngle = 0;
     QGraphicsView::resetTransform();
+    scheduleViewStateUpdate();
 }
 
 void GraphicsView::zoomView(qreal scaleFactor)
@@ -119,13 +188,12 @@ void GraphicsView::zoomView(qreal scaleFactor)
     m_enableFitInView = false;
     scale(scaleFactor, scaleFactor);
     applyTransformationModeByScaleFactor();
-    emit navigatorViewRequired(!isThingSmallerThanWindowWith(transform()), m_rotateAngle);
+    scheduleViewStateUpdate();
 }
 
 void GraphicsView::resetScale()
 {
     resetWithScaleAndRotate(1, m_rotateAngle);
-    emit navigatorViewRequired(!isThingSmallerThanWindowWith(transform()), m_rotateAngle);
 }
 
 void GraphicsView::rotateView(qreal rotateAngle)
@@ -139,6 +207,7 @@ void GraphicsView::fitInView(const QRectF &rect, Qt::AspectRatioMode aspectRadio
 {
     QGraphicsView::fitInView(rect, aspectRadioMode);
     applyTransformationModeByScaleFactor();
+    scheduleViewStateUpdate();
 }
 
 void GraphicsView::checkAndDoFitInView(bool markItOnAnyway)
@@ -154,11 +223,81 @@ void GraphicsView::checkAndDoFitInView(bool markItOnAnyway)
     }
 }
 
+void GraphicsView::setOpenGLEnabled(bool enabled)
+{
+    const bool wasEnabled = isOpenGLEnabled();
+    if (GLViewport::install(this, enabled) == wasEnabled) {
+        return;
+    }
+
+    // 切换视口会重设更新方式，HUD 仍然需要整个视口重绘
+    if (m_hudEnabled) {
+        m_savedUpdateMode = viewportUpdateMode();
+        setViewportUpdateMode(QGraphicsView::FullViewportUpdate);
+    }
+}
+
+bool GraphicsView::isOpenGLEnabled() const
+{
+    return qobject_cast<GLViewport *>(viewport()) != nullptr;
+}
+
+void GraphicsView::matchView(const GraphicsView *other)
+{
+    const QRectF otherRect(other->sceneRect());
+    const QRectF rect(sceneRect());
+    if (otherRect.isEmpty() || rect.isEmpty()) {
+        return;
+    }
+
+    const QPointF otherCenter(other->mapToScene(other->viewport()->rect().center()));
+    const QPointF relativeCenter((otherCenter.x() - otherRect.left()) / otherRect.width(),
+                                 (otherCenter.y() - otherRect.top()) / otherRect.height());
+
+    // 先把本场景缩放到 other 场景的大小，再使用 other 的变换
+    const qreal ratio = otherRect.width() / rect.width();
+    m_rotateAngle = other->m_rotateAngle;
+    m_enableFitInView = other->m_enableFitInView;
+    setTransform(QTransform::fromScale(ratio, ratio) * other->transform());
+    centerOn(rect.left() + relativeCenter.x() * rect.width(), rect.top() + relativeCenter.y() * rect.height());
+    applyTransformationModeByScaleFactor();
+    scheduleViewStateUpdate();
+}
+
 void GraphicsView::toggleCheckerboard()
 {
     setCheckerboardEnabled(!m_checkerboardEnabled);
 }
 
+void GraphicsView::toggleHud()
+{
+    m_hudEnabled = !m_hudEnabled;
+
+    if (!m_hudRefreshTimer) {
+        // 没有交互时也定期刷新，显示后台解码等的最新数据
+        m_hudRefreshTimer = new QTimer(this);
+        m_hudRefreshTimer->setInterval(500);
+        // 视口可能被替换，每次都取当前的视口
+        connect(m_hudRefreshTimer, &QTimer::timeout, this, [this]() {
+            viewport()->update();
+        });
+    }
+
+    if (m_hudEnabled) {
+        // HUD 固定在视口上，滚动时不能只重绘移动过的部分
+        m_savedUpdateMode = viewportUpdateMode();
+        setViewportUpdateMode(QGraphicsView::FullViewportUpdate);
+        m_hudClock.start();
+        m_frameStamps.clear();
+        m_hudRefreshTimer->start();
+    } else {
+        setViewportUpdateMode(m_savedUpdateMode);
+        m_hudRefreshTimer->stop();
+    }
+
+    viewport()->update();
+}
+
 void GraphicsView::mousePressEvent(QMouseEvent *event)
 {
     if (shouldIgnoreMousePressMoveEvent(event)) {
@@ -207,11 +346,83 @@ void GraphicsView::resizeEvent(QResizeEvent *event)
         }
     } else {
         // 是否显示缩略图
-        emit navigatorViewRequired(!isThingSmallerThanWindowWith(transform()), m_rotateAngle);
+        scheduleViewStateUpdate();
     }
     return QGraphicsView::resizeEvent(event);
 }
 
+void GraphicsView::paintEvent(QPaintEvent *event)
+{
+    if (!m_hudEnabled) {
+        return QGraphicsView::paintEvent(event);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    QGraphicsView::paintEvent(event);
+    m_lastPaintUs = timer.nsecsElapsed() / 1000;
+
+    const qint64 now = m_hudClock.elapsed();
+    m_frameStamps.enqueue(now);
+    while (m_frameStamps.head() < now - 1000) {
+        m_frameStamps.dequeue();
+    }
+}
+
+void GraphicsView::drawForeground(QPainter *painter, const QRectF &rect)
+{
+    Q_UNUSED(rect);
+
+    if (!m_hudEnabled) {
+        return;
+    }
+
+    const PipelineStats *stats = PipelineStats::instance();
+
+    QStringList cacheRates;
+    for (int i = 0; i < PipelineStats::CacheCount; i++) {
+        const PipelineStats::Cache cache = static_cast<PipelineStats::Cache>(i);
+        const int lookups = stats->cacheLookups(cache);
+        cacheRates << QStringLiteral("%1 %2").arg(QLatin1String(PipelineStats::cacheName(cache)),
+                                                  lookups ? QString::number(100 * stats->cacheHits(cache) / lookups) + '%'
+                                                          : QStringLiteral("-"));
+    }
+
+    const QStringList lines {
+        QStringLiteral("paint %1 ms  %2 fps").arg(m_lastPaintUs / 1000.0, 0, 'f', 2).arg(m_frameStamps.count()),
+        QStringLiteral("io %1 / decode %2 / upload %3 ms")
+                .arg(stats->lastIoUs() / 1000.0, 0, 'f', 1)
+                .arg(stats->lastDecodeUs() / 1000.0, 0, 'f', 1)
+                .arg(stats->lastUploadUs() / 1000.0, 0, 'f', 1),
+        QStringLiteral("scale %1%  %2").arg(scaleFactor() * 100, 0, 'f', 1)
+                .arg(scene()->transformationMode() == Qt::SmoothTransformation ? "smooth" : "fast"),
+        QStringLiteral("cache ") + cacheRates.join(QStringLiteral("  ")),
+        QStringLiteral("image memory %1 MB  peak %2 MB")
+                .arg(ImageMemory::instance()->liveBytes() / 1048576.0, 0, 'f', 1)
+                .arg(ImageMemory::instance()->peakBytes() / 1048576.0, 0, 'f', 1)
+    };
+
+    // 在视口坐标中绘制，不受缩放和旋转影响
+    painter->save();
+    painter->resetTransform();
+    QFont font(painter->font());
+    font.setStyleHint(QFont::Monospace);
+    font.setFamily(QStringLiteral("monospace"));
+    font.setPointSizeF(8);
+    painter->setFont(font);
+
+    const int lineHeight = painter->fontMetrics().height();
+    const QRect box(0, viewport()->height() - lineHeight * lines.count() - 12, 300, lineHeight * lines.count() + 12);
+    painter->fillRect(box, QColor(0, 0, 0, 160));
+    painter->setPen(Qt::white);
+    int y = box.top() + 6;
+    for (const QString &line : lines) {
+        painter->drawText(QRect(box.left() + 6, y, box.width() - 12, lineHeight), Qt::AlignLeft | Qt::AlignVCenter, line);
+        y += lineHeight;
+    }
+    painter->restore();
+}
+
 void GraphicsView::dragEnterEvent(QDragEnterEvent *event)
 {
     if (event->mimeData()->hasUrls() || event->mimeData()->hasImage() || event->mimeData()->hasText()) {
@@ -243,8 +454,11 @@ void GraphicsView::dropEvent(QDropEvent *event)
         const QList<QUrl> &urls = mimeData->urls();
         if (urls.isEmpty()) {
             showText(tr("File url list is empty"));
-        } else {
+        } else if (urls.count() == 1 && !QFileInfo(urls.first().toLocalFile()).isDir()) {
             showFileFromUrl(urls.first(), true);
+        } else {
+            // 拖入多个文件或文件夹时，图库只包含拖入的内容
+            emit requestGalleryFromUrls(urls);
         }
     } else if (mimeData->hasImage()) {
         qDebug() << Q_FUNC_INFO << "this is image";
@@ -319,4 +533,65 @@ void GraphicsView::resetWithScaleAndRotate(qreal scaleFactor, qreal rotateAngle)
     QGraphicsView::resetTransform();
     scale(scaleFactor, scaleFactor);
     rotate(rotateAngle);
+    scheduleViewStateUpdate();
+}
+
+void GraphicsView::scheduleViewStateUpdate()
+{
+    emit viewChanged();
+
+    // 不重新计时：连续的变化最多延迟一帧
+    if (!m_viewStateTimer.isActive()) {
+        m_viewStateTimer.start();
+    }
+}
+
+void GraphicsView::emitViewStateChanged()
+{
+    updateDetailRegion();
+    emit viewStateChanged(transform(), !isThingSmallerThanWindowWith(transform()), m_rotateAngle);
+}
+
+void GraphicsView::stopRegionDecoding()
+{
+    m_regionLoader->setFilePath(QString());
+    m_requestedRegion = QRect();
+    m_requestedScale = 0;
+}
+
+void GraphicsView::updateDetailRegion()
+{
+    if (m_regionLoader->filePath().isEmpty() || !scene()->isOverview()) {
+        return;
+    }
+
+    const QRect imageRect(scene()->sceneRect().toAlignedRect());
+    const QRect visible(mapToScene(viewport()->rect()).boundingRect().toAlignedRect().intersected(imageRect));
+    // 每个原图像素在屏幕上对应的物理像素数，最多按原图大小解码
+    const qreal scale = qMin<qreal>(1, scaleFactor() * devicePixelRatioF());
+
+    // 概览图已经足够清晰时不需要局部图
+    if (visible.isEmpty() || scale <= scene()->overviewScale()) {
+        if (m_requestedRegion.isValid()) {
+            m_regionLoader->cancel();
+            scene()->clearDetail();
+            m_requestedRegion = QRect();
+            m_requestedScale = 0;
+        }
+        return;
+    }
+
+    if (m_requestedRegion.contains(visible) && qFuzzyCompare(m_requestedScale, scale)) {
+        return;
+    }
+
+    // 局部图的大小只与视口大小有关，与原图大小无关
+    const int marginX = qRound(visible.width() * DetailMargin);
+    const int marginY = qRound(visible.height() * DetailMargin);
+    const QRect region(visible.adjusted(-marginX, -marginY, marginX, marginY).intersected(imageRect));
+    const QSize scaledSize(QSize(qCeil(region.width() * scale), qCeil(region.height() * scale)).expandedTo(QSize(1, 1)));
+
+    m_requestedRegion = region;
+    m_requestedScale = scale;
+    m_regionLoader->request(region, scaledSize);
 }
@@ -1,10 +1,14 @@
 #ifndef GRAPHICSVIEW_H
 #define GRAPHICSVIEW_H
 
+#include <QElapsedTimer>
 #include <QGraphicsView>
+#include <QQueue>
+#include <QTimer>
 #include <QUrl>
 
 class GraphicsScene;
+class RegionLoader;
 class GraphicsView : public QGraphicsView
 {
     Q_OBJECT
@@ -15,14 +19,17 @@ public:
 
     void showImage(const QPixmap &pixmap);
     void showImage(const QImage &image);
+    // 很大的图片：先显示概览图，放大后在后台按需解码可见区域
+    void showOverview(const QImage &overview, const QString &filePath, const QSize &fullSize);
     void showText(const QString &text);
     void showSvg(const QString &filepath);
-    void showGif(const QString &filepath);
+    void showGif(const QString &filepath, const QByteArray &format = QByteArray());
 
     GraphicsScene * scene() const;
     void setScene(GraphicsScene *scene);
 
     qreal scaleFactor() const;
+    qreal rotateAngle() const;
 
     void resetTransform();
     void zoomView(qreal scaleFactor);
@@ -32,13 +39,24 @@ public:
 
     void checkAndDoFitInView(bool markItOnAnyway = true);
 
+    // 使用 GLViewport 绘制，OpenGL 不可用时保持光栅绘制
+    void setOpenGLEnabled(bool enabled);
+    bool isOpenGLEnabled() const;
+
+    // 使用与 other 相同的缩放、旋转和中心位置，图片大小不同时按相同的显示大小对齐
+    void matchView(const GraphicsView *other);
+
 signals:
-   void navigatorViewRequired(bool required, qreal angle);
-   void viewportRectChanged();
+   // 缩放、旋转、滚动和窗口大小的变化在一帧内只通知一次，携带最终的变换
+   void viewStateChanged(const QTransform &transform, bool navigatorRequired, qreal rotateAngle);
+   // 每次变化都立即发出，用于在同一帧内同步其它视图
+   void viewChanged();
    void requestGallery(const QString &filePath);
+   void requestGalleryFromUrls(const QList<QUrl> &urls);
 
 public slots:
     void toggleCheckerboard();
+    void toggleHud(); // 帧时间和加载流程统计
 
 private:
     void mousePressEvent(QMouseEvent *event)      override;
@@ -46,6 +64,8 @@ private:
     void mouseReleaseEvent(QMouseEvent *event)    override;
     void wheelEvent(QWheelEvent *event)           override;
     void resizeEvent(QResizeEvent *event)         override;
+    void paintEvent(QPaintEvent *event)           override;
+    void drawForeground(QPainter *painter, const QRectF &rect) override;
 
     void dragEnterEvent(QDragEnterEvent *event)   override;
     void dragMoveEvent(QDragMoveEvent *event)     override;
@@ -62,10 +82,28 @@ private:
 
     void resetWithScaleAndRotate(qreal scaleFactor, qreal rotateAngle);
 
+    void scheduleViewStateUpdate();
+    void emitViewStateChanged();
+
+    void stopRegionDecoding();
+    void updateDetailRegion();
+
     bool m_enableFitInView     = false;
     bool m_checkerboardEnabled = false;
 
     qreal m_rotateAngle = 0;
+    QTimer m_viewStateTimer;
+
+    RegionLoader *m_regionLoader;
+    QRect m_requestedRegion;    // 已显示或正在解码的局部图区域
+    qreal m_requestedScale = 0;
+
+    bool m_hudEnabled = false;
+    qint64 m_lastPaintUs = 0;
+    QElapsedTimer m_hudClock;
+    QQueue<qint64> m_frameStamps; // 最近一秒内每帧的时间
+    QTimer *m_hudRefreshTimer = nullptr;
+    ViewportUpdateMode m_savedUpdateMode = MinimalViewportUpdate;
 };
 
 #endif // GRAPHICSVIEW_H
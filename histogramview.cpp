@@ -0,0 +1,137 @@
+#include "histogramview.h"
+
+#include <QPainter>
+#include <QPainterPath>
+
+namespace {
+
+const int HistogramHeight = 90;
+
+} // namespace
+
+HistogramView::HistogramView(QWidget *parent)
+    : QWidget(parent)
+    , m_watcher(new QFutureWatcher<ImageStatistics>(this))
+{
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+
+    m_coalesceTimer.setSingleShot(true);
+    m_coalesceTimer.setInterval(50);
+    connect(&m_coalesceTimer, &QTimer::timeout, this, &HistogramView::startCompute);
+    connect(m_watcher, &QFutureWatcher<ImageStatistics>::finished, this, &HistogramView::onComputeFinished);
+}
+
+void HistogramView::requestUpdate(const QImage &image, const QRect &region)
+{
+    m_pendingImage = image;
+    m_pendingRegion = region & image.rect();
+    m_coalesceTimer.start();
+}
+
+void HistogramView::clear()
+{
+    m_coalesceTimer.stop();
+    m_pendingImage = QImage();
+    m_statistics = ImageStatistics();
+    update();
+}
+
+void HistogramView::startCompute()
+{
+    if (m_pendingImage.isNull()) {
+        return;
+    }
+
+    // 同一时间只有一个统计任务，结束后再处理最新的请求
+    if (m_watcher->isRunning()) {
+        return;
+    }
+
+    const bool fullImage = m_pendingRegion.isEmpty() || m_pendingRegion == m_pendingImage.rect();
+    if (fullImage && m_pendingImage.cacheKey() == m_fullCacheKey && m_fullStatistics.isValid()) {
+        m_statistics = m_fullStatistics;
+        m_pendingImage = QImage();
+        update();
+        return;
+    }
+
+    m_runningCacheKey = fullImage ? m_pendingImage.cacheKey() : 0;
+    m_watcher->setFuture(ImageStatistics::compute(m_pendingImage, m_pendingRegion));
+    m_pendingImage = QImage();
+}
+
+void HistogramView::onComputeFinished()
+{
+    m_statistics = m_watcher->result();
+    if (m_runningCacheKey != 0) {
+        m_fullStatistics = m_statistics;
+        m_fullCacheKey = m_runningCacheKey;
+    }
+    update();
+
+    if (!m_pendingImage.isNull() && !m_coalesceTimer.isActive()) {
+        startCompute();
+    }
+}
+
+void HistogramView::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+
+    QPainter painter(this);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(QColor(0, 0, 0, 120));
+    painter.drawRoundedRect(rect(), 3, 3);
+
+    if (!m_statistics.isValid()) {
+        return;
+    }
+
+    const QRectF plot(8, 8, width() - 16, HistogramHeight);
+    quint32 peak = 1;
+    for (const ChannelStatistics &channel : m_statistics.channels) {
+        // 两端的桶常常因为过曝/欠曝而特别高，不参与纵轴缩放
+        for (int i = 1; i < 255; i++) {
+            peak = qMax(peak, channel.histogram[i]);
+        }
+    }
+
+    static const QColor colors[ImageStatistics::ChannelCount] = {
+        QColor(255, 60, 60), QColor(60, 255, 60), QColor(60, 120, 255)
+    };
+
+    painter.setCompositionMode(QPainter::CompositionMode_Plus);
+    for (int c = 0; c < ImageStatistics::ChannelCount; c++) {
+        QPainterPath path(plot.bottomLeft());
+        for (int i = 0; i < 256; i++) {
+            const qreal value = qMin<qreal>(1, qreal(m_statistics.channels[c].histogram[i]) / peak);
+            path.lineTo(plot.left() + plot.width() * i / 255, plot.bottom() - plot.height() * value);
+        }
+        path.lineTo(plot.bottomRight());
+        path.closeSubpath();
+
+        QColor color(colors[c]);
+        color.setAlpha(150);
+        painter.setBrush(color);
+        painter.drawPath(path);
+    }
+    painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+
+    static const char *names[ImageStatistics::ChannelCount] = { "R", "G", "B" };
+    QFont font(painter.font());
+    font.setPointSizeF(8);
+    painter.setFont(font);
+    painter.setPen(Qt::white);
+    const int lineHeight = painter.fontMetrics().height();
+    int y = static_cast<int>(plot.bottom()) + 4;
+    for (int c = 0; c < ImageStatistics::ChannelCount; c++) {
+        const ChannelStatistics &channel = m_statistics.channels[c];
+        painter.drawText(QRect(8, y, width() - 16, lineHeight), Qt::AlignLeft | Qt::AlignVCenter,
+                         QStringLiteral("%1  %2 / %3 / %4   %5% / %6%")
+                         .arg(QLatin1String(names[c]))
+                         .arg(channel.min).arg(channel.mean, 0, 'f', 1).arg(channel.max)
+                         .arg(channel.clippedLow, 0, 'f', 1).arg(channel.clippedHigh, 0, 'f', 1));
+        y += lineHeight;
+    }
+}
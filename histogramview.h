@@ -0,0 +1,43 @@
+#ifndef HISTOGRAMVIEW_H
+#define HISTOGRAMVIEW_H
+
+#include "imagestatistics.h"
+
+#include <QFutureWatcher>
+#include <QTimer>
+#include <QWidget>
+
+/**
+ * @brief 左上角的直方图和通道统计浮层
+ *
+ * 统计在线程池中完成；放大查看时只统计当前可见的区域，整图的结果会被保留，
+ * 缩小回整图时无需重新计算。
+ */
+class HistogramView : public QWidget
+{
+    Q_OBJECT
+public:
+    HistogramView(QWidget *parent = nullptr);
+
+    // 请求统计 image 中 region 区域，短时间内的多次请求会被合并为一次
+    void requestUpdate(const QImage &image, const QRect &region);
+    void clear();
+
+private:
+    void paintEvent(QPaintEvent *event) override;
+
+    void startCompute();
+    void onComputeFinished();
+
+    ImageStatistics m_statistics;
+    ImageStatistics m_fullStatistics;
+    qint64 m_fullCacheKey = 0;
+
+    QImage m_pendingImage;
+    QRect  m_pendingRegion;
+    qint64 m_runningCacheKey = 0;
+    QTimer m_coalesceTimer;
+    QFutureWatcher<ImageStatistics> *m_watcher = nullptr;
+};
+
+#endif // HISTOGRAMVIEW_H
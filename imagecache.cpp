@@ -0,0 +1,405 @@
+#include "imagecache.h"
+
+#include "formatdispatcher.h"
+#include "imageloader.h"
+#include "taskscheduler.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+
+#include <zlib.h>
+
+#include <cstring>
+
+namespace {
+
+// 每个条带约 4 MB
+const int StripeBytes = 4 * 1024 * 1024;
+
+// 原文件比解码后的像素小得多、解码又快的格式，冷层直接保存原文件
+bool isCheapToDecode(const QByteArray &format)
+{
+    return format == "jpeg" || format == "png" || format == "bmp"
+            || format == "ppm" || format == "pgm" || format == "pbm";
+}
+
+struct Stripe
+{
+    const QImage *image;
+    int firstRow;
+    int rowCount;
+};
+
+// 每行与左边相邻像素做差分(同 PNG 的 Sub 滤波)，照片也能压缩得更小
+QByteArray compressStripe(const Stripe &stripe)
+{
+    const QImage &image = *stripe.image;
+    const int bytesPerLine = image.bytesPerLine();
+    const int bpp = qMax(1, image.depth() / 8);
+
+    QByteArray filtered(stripe.rowCount * bytesPerLine, Qt::Uninitialized);
+    for (int y = 0; y < stripe.rowCount; y++) {
+        const uchar *source = image.constScanLine(stripe.firstRow + y);
+        uchar *target = reinterpret_cast<uchar *>(filtered.data()) + qint64(y) * bytesPerLine;
+        memcpy(target, source, static_cast<size_t>(bpp));
+        for (int i = bpp; i < bytesPerLine; i++) {
+            target[i] = uchar(source[i] - source[i - bpp]);
+        }
+    }
+
+    uLongf length = compressBound(static_cast<uLong>(filtered.size()));
+    QByteArray compressed(static_cast<int>(length), Qt::Uninitialized);
+    if (compress2(reinterpret_cast<Bytef *>(compressed.data()), &length,
+                  reinterpret_cast<const Bytef *>(filtered.constData()), static_cast<uLong>(filtered.size()),
+                  Z_BEST_SPEED) != Z_OK) {
+        return QByteArray();
+    }
+    compressed.truncate(static_cast<int>(length));
+    return compressed;
+}
+
+} // namespace
+
+qint64 ImageCache::ColdEntry::bytes() const
+{
+    qint64 result = encoded.size();
+    for (const QByteArray &stripe : stripes) {
+        result += stripe.size();
+    }
+    return result;
+}
+
+ImageCache::ImageCache(QObject *parent)
+    : QObject(parent)
+{
+}
+
+bool ImageCache::lookup(const QString &filePath, QImage *image, QSize *fullSize)
+{
+    m_current = filePath;
+
+    QHash<QString, HotEntry>::const_iterator it = m_hot.constFind(filePath);
+    if (it == m_hot.constEnd()) {
+        return false;
+    }
+    if (!isUnchanged(filePath, it->fileSize, it->lastModified)) {
+        invalidate(filePath);
+        return false;
+    }
+
+    *image = it->image;
+    *fullSize = it->fullSize;
+    return true;
+}
+
+bool ImageCache::coldEntry(const QString &filePath, ColdEntry *entry)
+{
+    QHash<QString, ColdEntry>::const_iterator it = m_cold.constFind(filePath);
+    if (it == m_cold.constEnd()) {
+        return false;
+    }
+    if (!isUnchanged(filePath, it->fileSize, it->lastModified)) {
+        invalidate(filePath);
+        return false;
+    }
+
+    *entry = *it;
+    m_coldOrder.removeOne(filePath);
+    m_coldOrder.append(filePath);
+    return true;
+}
+
+bool ImageCache::peek(const QString &filePath, QImage *image, QSize *fullSize, ColdEntry *cold) const
+{
+    // 文件已经被修改的条目视为未命中，留给图库自己的查找去清除
+    bool found = false;
+    QHash<QString, HotEntry>::const_iterator hot = m_hot.constFind(filePath);
+    if (hot != m_hot.constEnd() && isUnchanged(filePath, hot->fileSize, hot->lastModified)) {
+        *image = hot->image;
+        *fullSize = hot->fullSize;
+        found = true;
+    }
+
+    QHash<QString, ColdEntry>::const_iterator it = m_cold.constFind(filePath);
+    if (it != m_cold.constEnd() && isUnchanged(filePath, it->fileSize, it->lastModified)) {
+        *cold = *it;
+        found = true;
+    }
+    return found;
+}
+
+void ImageCache::insert(const QString &filePath, const QImage &image, const QSize &fullSize)
+{
+    if (image.isNull()) {
+        return;
+    }
+
+    const QFileInfo info(filePath);
+    m_current = filePath;
+    m_hot.insert(filePath, HotEntry { image, fullSize, info.size(), info.lastModified() });
+    trimHot();
+    updateMemoryUsage();
+}
+
+void ImageCache::setPosition(const QStringList &files, int index)
+{
+    m_window.clear();
+    if (index < 0 || index >= files.count()) {
+        return;
+    }
+
+    m_current = files.at(index);
+    for (int i = qMax(0, index - HotRadius); i <= qMin(files.count() - 1, index + HotRadius); i++) {
+        m_window.insert(files.at(i));
+    }
+
+    trimHot();
+    for (const QString &filePath : qAsConst(m_window)) {
+        if (!m_hot.contains(filePath) && m_cold.contains(filePath)) {
+            promote(filePath);
+        }
+    }
+    updateMemoryUsage();
+}
+
+void ImageCache::invalidate(const QString &filePath)
+{
+    // 这个文件正在后台处理的结果也作废，其它文件的不受影响
+    if (m_working.contains(filePath)) {
+        m_working.take(filePath)->storeRelease(1);
+    }
+
+    m_hot.remove(filePath);
+    if (m_cold.contains(filePath)) {
+        m_coldBytes -= m_cold.take(filePath).bytes();
+        m_coldOrder.removeOne(filePath);
+    }
+    updateMemoryUsage();
+}
+
+void ImageCache::clear()
+{
+    for (const TaskScheduler::CancellationToken &token : qAsConst(m_working)) {
+        token->storeRelease(1);
+    }
+    m_working.clear();
+    m_hot.clear();
+    m_cold.clear();
+    m_coldOrder.clear();
+    m_coldBytes = 0;
+    m_window.clear();
+    m_current.clear();
+    updateMemoryUsage();
+}
+
+ImageCache::ColdEntry ImageCache::compress(const QString &filePath, const QImage &image, const QSize &fullSize)
+{
+    ColdEntry entry;
+    entry.fullSize = fullSize;
+
+    const QFileInfo info(filePath);
+    entry.fileSize = info.size();
+    entry.lastModified = info.lastModified();
+
+    // 概览图不是原文件的完整内容，只能保存像素
+    const QByteArray format = FormatDispatcher::instance()->sniff(filePath).format;
+    if (isCheapToDecode(format) && image.size() == fullSize && entry.fileSize * 2 <= image.sizeInBytes()) {
+        QFile file(filePath);
+        if (file.open(QIODevice::ReadOnly)) {
+            entry.encoded = file.readAll();
+            entry.format = format;
+            if (entry.encoded.size() == entry.fileSize) {
+                return entry;
+            }
+            entry.encoded.clear();
+        }
+    }
+
+    entry.size = image.size();
+    entry.imageFormat = image.format();
+    entry.colorTable = image.colorTable();
+    entry.stripeRows = qMax(1, StripeBytes / image.bytesPerLine());
+
+    QVector<Stripe> stripes;
+    for (int y = 0; y < image.height(); y += entry.stripeRows) {
+        stripes.append(Stripe { &image, y, qMin(entry.stripeRows, image.height() - y) });
+    }
+    entry.stripes = QtConcurrent::blockingMapped<QVector<QByteArray> >(stripes, compressStripe);
+    for (const QByteArray &stripe : qAsConst(entry.stripes)) {
+        if (stripe.isEmpty()) {
+            return ColdEntry();
+        }
+    }
+    return entry;
+}
+
+QImage ImageCache::restore(const ColdEntry &entry, const QAtomicInt *cancelled)
+{
+    if (!entry.encoded.isEmpty()) {
+        return ImageLoader::decodeData(entry.encoded, entry.format, cancelled);
+    }
+
+    QImage image(entry.size, entry.imageFormat);
+    if (image.isNull()) {
+        return QImage();
+    }
+    image.setColorTable(entry.colorTable);
+
+    // 各条带直接解压到目标图片对应的行中
+    uchar *bits = image.bits();
+    const int bytesPerLine = image.bytesPerLine();
+    const int bpp = qMax(1, image.depth() / 8);
+    QVector<int> indexes;
+    for (int i = 0; i < entry.stripes.count(); i++) {
+        indexes.append(i);
+    }
+
+    QAtomicInt failed(0);
+    QtConcurrent::blockingMap(indexes, [&](int index) {
+        if (cancelled && cancelled->loadAcquire()) {
+            failed.storeRelease(1);
+            return;
+        }
+
+        const int firstRow = index * entry.stripeRows;
+        const int rowCount = qMin(entry.stripeRows, entry.size.height() - firstRow);
+        uchar *target = bits + qint64(firstRow) * bytesPerLine;
+        uLongf length = static_cast<uLongf>(rowCount) * bytesPerLine;
+        const QByteArray &stripe = entry.stripes.at(index);
+        if (uncompress(target, &length, reinterpret_cast<const Bytef *>(stripe.constData()),
+                       static_cast<uLong>(stripe.size())) != Z_OK
+                || length != static_cast<uLongf>(rowCount) * bytesPerLine) {
+            failed.storeRelease(1);
+            return;
+        }
+
+        for (int y = 0; y < rowCount; y++) {
+            uchar *line = target + qint64(y) * bytesPerLine;
+            for (int i = bpp; i < bytesPerLine; i++) {
+                line[i] = uchar(line[i] + line[i - bpp]);
+            }
+        }
+    });
+
+    if (failed.loadAcquire()) {
+        return QImage();
+    }
+    return image;
+}
+
+bool ImageCache::isUnchanged(const QString &filePath, qint64 fileSize, const QDateTime &lastModified) const
+{
+    const QFileInfo info(filePath);
+    return info.exists() && info.size() == fileSize && info.lastModified() == lastModified;
+}
+
+void ImageCache::trimHot()
+{
+    QStringList outside;
+    for (QHash<QString, HotEntry>::const_iterator it = m_hot.constBegin(); it != m_hot.constEnd(); ++it) {
+        if (it.key() != m_current && !m_window.contains(it.key())) {
+            outside.append(it.key());
+        }
+    }
+    for (const QString &filePath : qAsConst(outside)) {
+        demote(filePath);
+    }
+}
+
+void ImageCache::demote(const QString &filePath)
+{
+    const HotEntry entry = m_hot.take(filePath);
+
+    // 已经在冷层中(之前从冷层恢复)的图片不用再压缩
+    if (m_cold.contains(filePath) || m_working.contains(filePath)) {
+        return;
+    }
+    const TaskScheduler::CancellationToken cancelled(new QAtomicInt(0));
+    m_working.insert(filePath, cancelled);
+
+    // 压缩完成前 QImage 的数据由后台任务持有
+    QFutureWatcher<ColdEntry> *watcher = new QFutureWatcher<ColdEntry>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, cancelled, filePath]() {
+        watcher->deleteLater();
+        // 被取消的任务已经从 m_working 中移除
+        if (cancelled->loadAcquire()) {
+            return;
+        }
+        m_working.remove(filePath);
+
+        const ColdEntry cold = watcher->result();
+        if (cold.isValid() && isUnchanged(filePath, cold.fileSize, cold.lastModified)) {
+            insertCold(filePath, cold);
+        }
+        updateMemoryUsage();
+    });
+
+    const QImage image(entry.image);
+    const QSize fullSize(entry.fullSize);
+    watcher->setFuture(TaskScheduler::instance()->run(TaskScheduler::Neighbor, [filePath, image, fullSize]() {
+        return compress(filePath, image, fullSize);
+    }, cancelled));
+}
+
+void ImageCache::promote(const QString &filePath)
+{
+    if (m_working.contains(filePath)) {
+        return;
+    }
+    const TaskScheduler::CancellationToken cancelled(new QAtomicInt(0));
+    m_working.insert(filePath, cancelled);
+
+    const ColdEntry cold = m_cold.value(filePath);
+    QFutureWatcher<QImage> *watcher = new QFutureWatcher<QImage>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, cancelled, filePath, cold]() {
+        watcher->deleteLater();
+        if (cancelled->loadAcquire()) {
+            return;
+        }
+        m_working.remove(filePath);
+
+        // 恢复期间位置可能又变了
+        const QImage image = watcher->result();
+        if (!image.isNull() && (m_window.contains(filePath) || filePath == m_current)
+                && !m_hot.contains(filePath)) {
+            m_hot.insert(filePath, HotEntry { image, cold.fullSize, cold.fileSize, cold.lastModified });
+            updateMemoryUsage();
+        }
+    });
+
+    watcher->setFuture(TaskScheduler::instance()->run(TaskScheduler::Neighbor, [cold, cancelled]() {
+        return restore(cold, cancelled.data());
+    }, cancelled));
+}
+
+void ImageCache::insertCold(const QString &filePath, const ColdEntry &entry)
+{
+    if (entry.bytes() > ColdBudgetBytes) {
+        return;
+    }
+
+    if (m_cold.contains(filePath)) {
+        m_coldBytes -= m_cold.value(filePath).bytes();
+    }
+    m_cold.insert(filePath, entry);
+    m_coldOrder.removeOne(filePath);
+    m_coldOrder.append(filePath);
+    m_coldBytes += entry.bytes();
+
+    // 淘汰最久没有查看的图片
+    while (m_coldBytes > ColdBudgetBytes && !m_coldOrder.isEmpty()) {
+        m_coldBytes -= m_cold.take(m_coldOrder.takeFirst()).bytes();
+    }
+}
+
+void ImageCache::updateMemoryUsage()
+{
+    qint64 hotBytes = 0;
+    for (const HotEntry &entry : qAsConst(m_hot)) {
+        hotBytes += ImageMemory::bytesOf(entry.image);
+    }
+    m_hotMemory.setBytes(hotBytes);
+    m_coldMemory.setBytes(m_coldBytes);
+}
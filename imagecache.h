@@ -0,0 +1,103 @@
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+#include "imagememory.h"
+#include "taskscheduler.h"
+
+#include <QAtomicInt>
+#include <QDateTime>
+#include <QHash>
+#include <QImage>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QVector>
+
+/**
+ * @brief 图库中已解码图片的两级缓存
+ *
+ * 热层保存可以直接显示的 QImage，只保留图库中当前位置前后 HotRadius 张。离开这个范围的图片在后台
+ * 降到冷层：JPEG、PNG 等解码很快的格式保存原文件的内容，其它格式保存快速压缩后的像素。冷层按最近
+ * 查看的顺序淘汰，回到其中的图片时不需要读盘，也不需要完整解码；位置变化时，新范围内的冷层图片会
+ * 提前在后台恢复到热层。
+ */
+class ImageCache : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ImageCache(QObject *parent = nullptr);
+
+    static const int HotRadius = 2;
+    static const qint64 ColdBudgetBytes = 512LL * 1024 * 1024;
+
+    struct ColdEntry
+    {
+        // 原文件的内容，为空时使用压缩后的像素
+        QByteArray encoded;
+        QByteArray format;
+
+        // 按行做差分后分条带压缩，可以并行解压
+        QVector<QByteArray> stripes;
+        int stripeRows = 0;
+        QSize size;
+        QImage::Format imageFormat = QImage::Format_Invalid;
+        QVector<QRgb> colorTable;
+
+        QSize fullSize;
+        qint64 fileSize = 0;
+        QDateTime lastModified;
+
+        bool isValid() const { return !encoded.isEmpty() || !stripes.isEmpty(); }
+        qint64 bytes() const;
+    };
+
+    // 命中热层时返回 true
+    bool lookup(const QString &filePath, QImage *image, QSize *fullSize);
+    // 命中冷层时返回 true，调用方在后台用 restore() 恢复
+    bool coldEntry(const QString &filePath, ColdEntry *entry);
+    // 只读的查找，供图库以外的窗口使用：不改变当前图片，也不改变冷层的淘汰顺序。
+    // 命中热层时填写 image 和 fullSize，命中冷层时填写 cold，两者都可能命中
+    bool peek(const QString &filePath, QImage *image, QSize *fullSize, ColdEntry *cold) const;
+    void insert(const QString &filePath, const QImage &image, const QSize &fullSize);
+
+    // 图库位置变化时调用，决定哪些图片留在热层
+    void setPosition(const QStringList &files, int index);
+    // 文件被修改后调用，只丢弃这个文件的缓存和正在后台处理的结果
+    void invalidate(const QString &filePath);
+    void clear();
+
+    // 可以在任意线程中调用
+    static ColdEntry compress(const QString &filePath, const QImage &image, const QSize &fullSize);
+    static QImage restore(const ColdEntry &entry, const QAtomicInt *cancelled = nullptr);
+
+private:
+    struct HotEntry
+    {
+        QImage image;
+        QSize fullSize;
+        qint64 fileSize;
+        QDateTime lastModified;
+    };
+
+    bool isUnchanged(const QString &filePath, qint64 fileSize, const QDateTime &lastModified) const;
+    void trimHot();
+    void demote(const QString &filePath);
+    void promote(const QString &filePath);
+    void insertCold(const QString &filePath, const ColdEntry &entry);
+    void updateMemoryUsage();
+
+    QHash<QString, HotEntry> m_hot;
+    QHash<QString, ColdEntry> m_cold;
+    QStringList m_coldOrder;     // 最近使用的在最后
+    qint64 m_coldBytes = 0;
+
+    QSet<QString> m_window;      // 应该留在热层的图片
+    QString m_current;
+    // 正在后台压缩或恢复的图片，每个任务有自己的取消标记
+    QHash<QString, TaskScheduler::CancellationToken> m_working;
+
+    ImageMemoryTicket m_hotMemory { ImageMemory::Cache };
+    ImageMemoryTicket m_coldMemory { ImageMemory::Cache };
+};
+
+#endif // IMAGECACHE_H
@@ -0,0 +1,81 @@
+#include "imagedifference.h"
+
+#include "taskscheduler.h"
+
+#include <QVector>
+#include <QtConcurrent>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <cstdlib>
+
+namespace {
+
+const int BandRows = 64;
+
+// count 个像素，结果的 alpha 固定为 255
+void absoluteDifference(const QRgb *first, const QRgb *second, QRgb *result, int count)
+{
+    int x = 0;
+#if defined(__SSE2__)
+    // 无符号饱和减法：|a - b| = (a - b) | (b - a)，其中一项总是 0
+    const __m128i opaque = _mm_set1_epi32(int(0xff000000));
+    for (; x + 4 <= count; x += 4) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first + x));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(second + x));
+        const __m128i difference = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(result + x), _mm_or_si128(difference, opaque));
+    }
+#elif defined(__ARM_NEON)
+    const uint8x16_t opaque = vreinterpretq_u8_u32(vdupq_n_u32(0xff000000));
+    for (; x + 4 <= count; x += 4) {
+        const uint8x16_t a = vld1q_u8(reinterpret_cast<const uint8_t *>(first + x));
+        const uint8x16_t b = vld1q_u8(reinterpret_cast<const uint8_t *>(second + x));
+        vst1q_u8(reinterpret_cast<uint8_t *>(result + x), vorrq_u8(vabdq_u8(a, b), opaque));
+    }
+#endif
+    for (; x < count; x++) {
+        const QRgb a = first[x];
+        const QRgb b = second[x];
+        result[x] = qRgb(std::abs(qRed(a) - qRed(b)), std::abs(qGreen(a) - qGreen(b)), std::abs(qBlue(a) - qBlue(b)));
+    }
+}
+
+} // namespace
+
+QFuture<QImage> ImageDifference::compute(const QImage &first, const QImage &second, const QRect &region)
+{
+    return TaskScheduler::instance()->run(TaskScheduler::Interaction, [first, second, region]() {
+        const QRect rect(region & first.rect());
+        if (rect.isEmpty() || first.size() != second.size()
+                || first.format() != QImage::Format_ARGB32 || second.format() != QImage::Format_ARGB32) {
+            return QImage();
+        }
+
+        QImage result(rect.size(), QImage::Format_RGB32);
+        if (result.isNull()) {
+            return QImage();
+        }
+
+        // 在并行计算前取得可写的数据，避免在多个线程中调用 scanLine()
+        uchar *bits = result.bits();
+        const int bytesPerLine = result.bytesPerLine();
+        QVector<int> bands;
+        for (int y = 0; y < rect.height(); y += BandRows) {
+            bands.append(y);
+        }
+        QtConcurrent::blockingMap(bands, [&](int top) {
+            const int bottom = qMin(top + BandRows, rect.height());
+            for (int y = top; y < bottom; y++) {
+                absoluteDifference(reinterpret_cast<const QRgb *>(first.constScanLine(rect.top() + y)) + rect.left(),
+                                   reinterpret_cast<const QRgb *>(second.constScanLine(rect.top() + y)) + rect.left(),
+                                   reinterpret_cast<QRgb *>(bits + qint64(y) * bytesPerLine), rect.width());
+            }
+        });
+        return result;
+    });
+}
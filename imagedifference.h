@@ -0,0 +1,21 @@
+#ifndef IMAGEDIFFERENCE_H
+#define IMAGEDIFFERENCE_H
+
+#include <QFuture>
+#include <QImage>
+#include <QRect>
+
+/**
+ * @brief 两张同样大小的图片逐像素的差的绝对值
+ *
+ * 只计算 region 区域(通常是当前可见的部分)，结果是 region 大小的 RGB32 图片。
+ * 每行用 SSE2/NEON 一次处理 16 个字节，各行分块在线程池中并行计算。
+ */
+class ImageDifference
+{
+public:
+    // 两张图片都应该是 Format_ARGB32，大小相同
+    static QFuture<QImage> compute(const QImage &first, const QImage &second, const QRect &region);
+};
+
+#endif // IMAGEDIFFERENCE_H
@@ -0,0 +1,168 @@
+#include "imageexporter.h"
+
+#include "imageloader.h"
+#include "pngstripeencoder.h"
+#include "taskscheduler.h"
+
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QImageWriter>
+#include <QPointer>
+#include <QSaveFile>
+
+namespace {
+
+// 取消后写入失败，编码器会尽快放弃
+class CancellableSaveFile : public QSaveFile
+{
+public:
+    CancellableSaveFile(const QString &name, const QAtomicInt *cancelled)
+        : QSaveFile(name)
+        , m_cancelled(cancelled)
+    {
+    }
+
+protected:
+    qint64 writeData(const char *data, qint64 len) override
+    {
+        if (m_cancelled->loadAcquire()) {
+            setErrorString(QStringLiteral("Export cancelled"));
+            return -1;
+        }
+        return QSaveFile::writeData(data, len);
+    }
+
+private:
+    const QAtomicInt *m_cancelled;
+};
+
+QByteArray formatForSuffix(const QString &suffix)
+{
+    const QString lowerSuffix = suffix.toLower();
+    if (lowerSuffix == QLatin1String("jpg") || lowerSuffix == QLatin1String("jpeg")) {
+        return "jpeg";
+    }
+    return lowerSuffix.toLatin1();
+}
+
+} // namespace
+
+ImageExporter::ImageExporter(QObject *parent)
+    : QObject(parent)
+{
+}
+
+QStringList ImageExporter::supportedSuffixes()
+{
+    return { QStringLiteral("png"), QStringLiteral("jpg"), QStringLiteral("jpeg"), QStringLiteral("webp") };
+}
+
+void ImageExporter::start(const QImage &image, qreal rotateAngle, const QString &filePath, int quality)
+{
+    startTask(image, QString(), ImageMemory::bytesOf(image), rotateAngle, filePath, quality);
+}
+
+void ImageExporter::startFromFile(const QString &sourcePath, qreal rotateAngle, const QString &filePath, int quality)
+{
+    // 只读取文件头估计解码后的大小
+    const QSize size = ImageLoader::imageSize(sourcePath);
+    startTask(QImage(), sourcePath, qint64(size.width()) * size.height() * 4, rotateAngle, filePath, quality);
+}
+
+void ImageExporter::startTask(const QImage &image, const QString &sourcePath, qint64 imageBytes,
+                              qreal rotateAngle, const QString &filePath, int quality)
+{
+    if (m_running) {
+        return;
+    }
+
+    m_running = true;
+    m_cancelled.reset(new QAtomicInt(0));
+    // 导出期间持有图片，旋转时还有一份旋转后的副本
+    m_memory.setBytes(imageBytes * (qFuzzyIsNull(rotateAngle) ? 1 : 2));
+
+    const QSharedPointer<QAtomicInt> cancelled(m_cancelled);
+    const QByteArray format = formatForSuffix(QFileInfo(filePath).suffix());
+    QPointer<ImageExporter> self(this);
+
+    // 进度在工作线程中产生，转发到当前线程再发出信号
+    PngStripeEncoder::ProgressCallback progress = [self](int done, int total) {
+        if (!self) {
+            return;
+        }
+        QMetaObject::invokeMethod(self.data(), [self, done, total]() {
+            if (self) {
+                emit self->progressChanged(done * 100 / total);
+            }
+        }, Qt::QueuedConnection);
+    };
+
+    // 解码原图和 PNG 以外的编码都无法估计进度
+    if (format != "png" || image.isNull()) {
+        emit progressChanged(-1);
+    }
+
+    QFutureWatcher<QString> *watcher = new QFutureWatcher<QString>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, cancelled]() {
+        watcher->deleteLater();
+        m_running = false;
+        m_memory.setBytes(0);
+        const QString errorString = watcher->result();
+        if (cancelled->loadAcquire()) {
+            emit finished(false, tr("Export cancelled"));
+        } else {
+            emit finished(errorString.isEmpty(), errorString);
+        }
+    });
+
+    watcher->setFuture(TaskScheduler::instance()->run(TaskScheduler::Neighbor,
+                                                      [image, sourcePath, rotateAngle, filePath, format, quality, cancelled, progress]() -> QString {
+        QImage source(image);
+        if (source.isNull()) {
+            source = ImageLoader::decode(sourcePath, QSize(), cancelled.data());
+            if (source.isNull()) {
+                return cancelled->loadAcquire() ? QString() : QStringLiteral("Cannot decode %1").arg(sourcePath);
+            }
+        }
+        const QImage rotated = qFuzzyIsNull(rotateAngle) ? source
+                                                         : source.transformed(QTransform().rotate(rotateAngle));
+
+        CancellableSaveFile file(filePath, cancelled.data());
+        if (!file.open(QIODevice::WriteOnly)) {
+            return file.errorString();
+        }
+
+        QString errorString;
+        if (format == "png") {
+            if (!PngStripeEncoder::encode(rotated, &file, 6, cancelled.data(), progress)) {
+                errorString = file.error() != QFileDevice::NoError ? file.errorString()
+                                                                   : QStringLiteral("PNG encoding failed");
+            }
+        } else {
+            QImageWriter writer(&file, format);
+            writer.setQuality(quality);
+            if (!writer.write(rotated)) {
+                errorString = writer.errorString();
+            }
+        }
+
+        if (!errorString.isEmpty() || cancelled->loadAcquire()) {
+            file.cancelWriting();
+            return errorString;
+        }
+
+        return file.commit() ? QString() : file.errorString();
+    }, cancelled));
+}
+
+void ImageExporter::cancel()
+{
+    if (m_running) {
+        m_cancelled->storeRelease(1);
+    }
+}
+
+bool ImageExporter::isRunning() const
+{
+    return m_running;
+}
@@ -0,0 +1,42 @@
+#ifndef IMAGEEXPORTER_H
+#define IMAGEEXPORTER_H
+
+#include "imagememory.h"
+
+#include <QAtomicInt>
+#include <QImage>
+#include <QObject>
+#include <QSharedPointer>
+
+/**
+ * @brief 在后台线程把图片编码保存为 PNG / JPEG / WebP，支持进度和取消
+ */
+class ImageExporter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ImageExporter(QObject *parent = nullptr);
+
+    static QStringList supportedSuffixes();
+
+    // 格式由文件后缀决定，rotateAngle 不为 0 时先按视图的角度旋转
+    void start(const QImage &image, qreal rotateAngle, const QString &filePath, int quality = -1);
+    // 在工作线程中从 sourcePath 解码原图后导出，用于只显示了概览图的很大的图片
+    void startFromFile(const QString &sourcePath, qreal rotateAngle, const QString &filePath, int quality = -1);
+    void cancel();
+    bool isRunning() const;
+
+signals:
+    void progressChanged(int percent); // -1 表示无法估计进度
+    void finished(bool success, const QString &errorString);
+
+private:
+    void startTask(const QImage &image, const QString &sourcePath, qint64 imageBytes,
+                   qreal rotateAngle, const QString &filePath, int quality);
+
+    QSharedPointer<QAtomicInt> m_cancelled;
+    bool m_running = false;
+    ImageMemoryTicket m_memory { ImageMemory::Export };
+};
+
+#endif // IMAGEEXPORTER_H
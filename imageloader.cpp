@@ -0,0 +1,291 @@
+#include "imageloader.h"
+
+#include "embeddedpreview.h"
+#include "formatdispatcher.h"
+#include "paralleldecoder.h"
+#include "pipelinestats.h"
+
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QImageReader>
+#include <QPainter>
+#include <QSvgRenderer>
+
+namespace {
+
+// 取消后让读取失败，解码器会尽快放弃；同时累计读取文件所用的时间
+class CancellableFile : public QFile
+{
+public:
+    CancellableFile(const QString &name, const QAtomicInt *cancelled)
+        : QFile(name)
+        , m_cancelled(cancelled)
+    {
+    }
+
+    qint64 readNsecs() const
+    {
+        return m_readNsecs;
+    }
+
+protected:
+    qint64 readData(char *data, qint64 maxlen) override
+    {
+        if (m_cancelled && m_cancelled->loadAcquire()) {
+            setErrorString(QStringLiteral("Decoding cancelled"));
+            return -1;
+        }
+        QElapsedTimer timer;
+        timer.start();
+        const qint64 result = QFile::readData(data, maxlen);
+        m_readNsecs += timer.nsecsElapsed();
+        return result;
+    }
+
+private:
+    const QAtomicInt *m_cancelled;
+    qint64 m_readNsecs = 0;
+};
+
+// 与 QImageReader 自动旋转的顺序一致：先镜像，再旋转 90 度
+QImage applyTransformation(const QImage &image, QImageIOHandler::Transformations transformation)
+{
+    if (transformation == QImageIOHandler::TransformationNone) {
+        return image;
+    }
+    QImage result = image.mirrored(transformation & QImageIOHandler::TransformationMirror,
+                                   transformation & QImageIOHandler::TransformationFlip);
+    if (transformation & QImageIOHandler::TransformationRotate90) {
+        result = result.transformed(QTransform().rotate(90));
+    }
+    return result;
+}
+
+// 把文件中存储的坐标映射为旋转后的坐标
+QTransform orientationTransform(QImageIOHandler::Transformations transformation, const QSize &storedSize)
+{
+    const QTransform mirror(transformation & QImageIOHandler::TransformationMirror ? -1 : 1, 0,
+                            0, transformation & QImageIOHandler::TransformationFlip ? -1 : 1,
+                            transformation & QImageIOHandler::TransformationMirror ? storedSize.width() : 0,
+                            transformation & QImageIOHandler::TransformationFlip ? storedSize.height() : 0);
+    if (!(transformation & QImageIOHandler::TransformationRotate90)) {
+        return mirror;
+    }
+    // 顺时针旋转 90 度：(x, y) -> (h - y, x)
+    return mirror * QTransform(0, 1, -1, 0, storedSize.height(), 0);
+}
+
+// 从 device 读取图片，动图只取第一帧
+QImage readImage(QIODevice *device, const QByteArray &format, const QSize &boundingSize,
+                 const QAtomicInt *cancelled, int imageIndex)
+{
+    // 全尺寸解码很大的 JPEG/PNG 时尽量用多个线程，不适用时返回空图片，继续用 QImageReader 解码
+    QImage image;
+    if (!boundingSize.isValid() && imageIndex == 0) {
+        image = ParallelDecoder::decode(device, format, cancelled);
+    }
+
+    QImageReader reader(device, format);
+    reader.setAutoTransform(true);
+    if (!image.isNull()) {
+        return applyTransformation(image, reader.transformation());
+    }
+
+    if (imageIndex > 0 && !reader.jumpToImage(imageIndex)) {
+        return QImage();
+    }
+
+    if (boundingSize.isValid()) {
+        QSize size = reader.size();
+        QSize bound = boundingSize;
+        // 读取到的尺寸是旋转之前的
+        if (reader.transformation() & QImageIOHandler::TransformationRotate90) {
+            bound.transpose();
+        }
+        if (size.isValid() && (size.width() > bound.width() || size.height() > bound.height())) {
+            size.scale(bound, Qt::KeepAspectRatio);
+            reader.setScaledSize(size);
+        }
+    }
+
+    return reader.read();
+}
+
+} // namespace
+
+QImage ImageLoader::decode(const QString &filePath, const QSize &boundingSize, const QAtomicInt *cancelled,
+                           int imageIndex)
+{
+    if (cancelled && cancelled->loadAcquire()) {
+        return QImage();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const SniffResult sniffed = FormatDispatcher::instance()->sniff(filePath);
+
+    if (sniffed.engine == EngineUnknown) {
+        return QImage();
+    }
+
+    if (sniffed.engine == EngineVector) {
+        QSvgRenderer renderer(filePath);
+        if (!renderer.isValid()) {
+            return QImage();
+        }
+
+        QSize size = renderer.defaultSize();
+        if (boundingSize.isValid()) {
+            size.scale(boundingSize, Qt::KeepAspectRatio);
+        }
+
+        QImage image(size, QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::transparent);
+        QPainter painter(&image);
+        renderer.render(&painter);
+        painter.end();
+        PipelineStats::instance()->recordDecode(0, timer.nsecsElapsed() / 1000);
+        return image;
+    }
+
+    if (sniffed.format == "raw") {
+        // 不解码传感器数据，使用内嵌的全尺寸预览图
+        const EmbeddedPreview::Preview preview = EmbeddedPreview::read(filePath);
+        const qint64 ioNsecs = timer.nsecsElapsed();
+        if (!preview.isValid() || (cancelled && cancelled->loadAcquire())) {
+            return QImage();
+        }
+        QImage image = EmbeddedPreview::decode(preview, boundingSize);
+        PipelineStats::instance()->recordDecode(ioNsecs / 1000, (timer.nsecsElapsed() - ioNsecs) / 1000);
+        return image;
+    }
+
+    CancellableFile file(filePath, cancelled);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QImage();
+    }
+
+    QImage image = readImage(&file, sniffed.format, boundingSize, cancelled, imageIndex);
+    // 中途取消时部分解码器会返回只解码了一部分的图片
+    if (cancelled && cancelled->loadAcquire()) {
+        return QImage();
+    }
+
+    PipelineStats::instance()->recordDecode(file.readNsecs() / 1000,
+                                            (timer.nsecsElapsed() - file.readNsecs()) / 1000);
+    return image;
+}
+
+int ImageLoader::imageCount(const QString &filePath)
+{
+    const SniffResult sniffed = FormatDispatcher::instance()->sniff(filePath);
+    if (sniffed.engine != EngineStill) {
+        return 1;
+    }
+
+    QImageReader reader(filePath, sniffed.format);
+    return qMax(1, reader.imageCount());
+}
+
+QSize ImageLoader::imageSize(const QString &filePath)
+{
+    const SniffResult sniffed = FormatDispatcher::instance()->sniff(filePath);
+    if (sniffed.engine != EngineStill) {
+        return QSize();
+    }
+
+    QImageReader reader(filePath, sniffed.format);
+    QSize size = reader.size();
+    if (reader.transformation() & QImageIOHandler::TransformationRotate90) {
+        size.transpose();
+    }
+    return size;
+}
+
+bool ImageLoader::supportsRegionDecoding(const QString &filePath)
+{
+    const SniffResult sniffed = FormatDispatcher::instance()->sniff(filePath);
+    if (sniffed.engine != EngineStill || sniffed.format == "raw") {
+        return false;
+    }
+
+    QImageReader reader(filePath, sniffed.format);
+    return reader.supportsOption(QImageIOHandler::ClipRect);
+}
+
+QImage ImageLoader::decodeRegion(const QString &filePath, const QRect &region, const QSize &scaledSize,
+                                 const QAtomicInt *cancelled)
+{
+    if (region.isEmpty() || scaledSize.isEmpty() || (cancelled && cancelled->loadAcquire())) {
+        return QImage();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const SniffResult sniffed = FormatDispatcher::instance()->sniff(filePath);
+    if (sniffed.engine != EngineStill) {
+        return QImage();
+    }
+
+    CancellableFile file(filePath, cancelled);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QImage();
+    }
+
+    // 自己处理旋转：裁剪和缩放都作用于文件中存储的方向
+    QImageReader reader(&file, sniffed.format);
+    reader.setAutoTransform(false);
+    const QSize storedSize = reader.size();
+    if (!storedSize.isValid()) {
+        return QImage();
+    }
+    const QImageIOHandler::Transformations transformation = reader.transformation();
+
+    const QRect storedRegion = orientationTransform(transformation, storedSize).inverted()
+            .mapRect(QRectF(region)).toAlignedRect().intersected(QRect(QPoint(0, 0), storedSize));
+    if (storedRegion.isEmpty()) {
+        return QImage();
+    }
+    QSize storedScaledSize = scaledSize;
+    if (transformation & QImageIOHandler::TransformationRotate90) {
+        storedScaledSize.transpose();
+    }
+
+    reader.setClipRect(storedRegion);
+    if (storedScaledSize != storedRegion.size()) {
+        reader.setScaledSize(storedScaledSize);
+    }
+
+    QImage image = reader.read();
+    if (cancelled && cancelled->loadAcquire()) {
+        return QImage();
+    }
+
+    PipelineStats::instance()->recordDecode(file.readNsecs() / 1000,
+                                            (timer.nsecsElapsed() - file.readNsecs()) / 1000);
+    return applyTransformation(image, transformation);
+}
+
+QImage ImageLoader::decodeData(const QByteArray &data, const QByteArray &format, const QAtomicInt *cancelled)
+{
+    if (cancelled && cancelled->loadAcquire()) {
+        return QImage();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+    QImage image = readImage(&buffer, format, QSize(), cancelled, 0);
+    if (cancelled && cancelled->loadAcquire()) {
+        return QImage();
+    }
+
+    PipelineStats::instance()->recordDecode(0, timer.nsecsElapsed() / 1000);
+    return image;
+}
@@ -0,0 +1,35 @@
+#ifndef IMAGELOADER_H
+#define IMAGELOADER_H
+
+#include <QAtomicInt>
+#include <QImage>
+#include <QString>
+
+/**
+ * @brief 把图片文件解码为 QImage，可以在任意线程中调用
+ */
+class ImageLoader
+{
+public:
+    // boundingSize 有效时图片会按比例缩小到不超过该尺寸，支持的格式(如 JPEG)会直接以较小的尺寸解码
+    // cancelled 被置为非零后，解码会在下一次读取文件时中止并返回空图片
+    // imageIndex 用于多页文件(如 TIFF、ICO)，指定要解码的页
+    static QImage decode(const QString &filePath, const QSize &boundingSize = QSize(),
+                         const QAtomicInt *cancelled = nullptr, int imageIndex = 0);
+
+    // 从内存中的文件内容解码，format 为 FormatDispatcher 探测到的格式
+    static QImage decodeData(const QByteArray &data, const QByteArray &format, const QAtomicInt *cancelled = nullptr);
+
+    // 只读取文件头得到页数，不解码；动图和矢量图返回 1
+    static int imageCount(const QString &filePath);
+
+    // 只读取文件头得到按 EXIF 方向旋转后的尺寸
+    static QSize imageSize(const QString &filePath);
+    // 解码器能否只解码一部分区域，而不是解码整张图片后再裁剪
+    static bool supportsRegionDecoding(const QString &filePath);
+    // region 是旋转后的图片坐标，结果缩放为 scaledSize(同样是旋转后的尺寸)
+    static QImage decodeRegion(const QString &filePath, const QRect &region, const QSize &scaledSize,
+                               const QAtomicInt *cancelled = nullptr);
+};
+
+#endif // IMAGELOADER_H
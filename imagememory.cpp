@@ -0,0 +1,181 @@
+#include "imagememory.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QImage>
+#include <QMutexLocker>
+#include <QPixmap>
+#include <QTextStream>
+#include <QTimer>
+
+ImageMemory *ImageMemory::instance()
+{
+    static ImageMemory memory;
+    return &memory;
+}
+
+qint64 ImageMemory::bytesOf(const QImage &image)
+{
+    return image.sizeInBytes();
+}
+
+qint64 ImageMemory::bytesOf(const QPixmap &pixmap)
+{
+    return qint64(pixmap.width()) * pixmap.height() * pixmap.depth() / 8;
+}
+
+const char *ImageMemory::ownerName(Owner owner)
+{
+    switch (owner) {
+    case Scene:
+        return "scene";
+    case Cache:
+        return "cache";
+    case Slideshow:
+        return "slideshow";
+    case Clipboard:
+        return "clipboard";
+    case Export:
+        return "export";
+    case Texture:
+        return "texture";
+    case OwnerCount:
+        break;
+    }
+    return "";
+}
+
+qint64 ImageMemory::liveBytes(Owner owner) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_live[owner];
+}
+
+qint64 ImageMemory::peakBytes(Owner owner) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_peak[owner];
+}
+
+qint64 ImageMemory::liveBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_totalLive;
+}
+
+qint64 ImageMemory::peakBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_totalPeak;
+}
+
+bool ImageMemory::startLogging(const QString &filePath, int intervalMs)
+{
+    QTimer *timer = new QTimer(QCoreApplication::instance());
+    QFile *file = new QFile(filePath, timer);
+    if (!file->open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        qWarning() << "Cannot write memory log" << filePath << file->errorString();
+        delete timer;
+        return false;
+    }
+
+    QTextStream header(file);
+    header << "time";
+    for (int owner = 0; owner < OwnerCount; owner++) {
+        header << ',' << ownerName(static_cast<Owner>(owner));
+    }
+    header << ",total,peak" << '\n';
+    header.flush();
+    file->flush();
+
+    QObject::connect(timer, &QTimer::timeout, timer, [this, file]() {
+        QTextStream line(file);
+        line << QDateTime::currentDateTime().toString(Qt::ISODate);
+        QMutexLocker locker(&m_mutex);
+        for (qint64 bytes : m_live) {
+            line << ',' << bytes;
+        }
+        line << ',' << m_totalLive << ',' << m_totalPeak << '\n';
+        locker.unlock();
+        line.flush();
+        file->flush();
+    });
+    timer->start(intervalMs);
+
+    return true;
+}
+
+void ImageMemory::adjust(Owner owner, qint64 delta)
+{
+    if (delta == 0) {
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_live[owner] += delta;
+    m_totalLive += delta;
+    Q_ASSERT(m_live[owner] >= 0);
+    m_peak[owner] = qMax(m_peak[owner], m_live[owner]);
+    m_totalPeak = qMax(m_totalPeak, m_totalLive);
+}
+
+ImageMemoryTicket::ImageMemoryTicket(ImageMemory::Owner owner, qint64 bytes)
+    : m_owner(owner)
+{
+    setBytes(bytes);
+}
+
+ImageMemoryTicket::~ImageMemoryTicket()
+{
+    reset(0);
+}
+
+void ImageMemoryTicket::setBytes(qint64 bytes)
+{
+    ImageMemory::instance()->adjust(m_owner, bytes - m_bytes);
+    m_bytes = bytes;
+}
+
+void ImageMemoryTicket::reset(qint64 bytes)
+{
+    checkAttachedReleased();
+    setBytes(bytes);
+}
+
+void ImageMemoryTicket::attach(QObject *object)
+{
+#ifndef QT_NO_DEBUG
+    m_attached.append(QPointer<QObject>(object));
+#else
+    Q_UNUSED(object);
+#endif // QT_NO_DEBUG
+}
+
+void ImageMemoryTicket::checkAttachedReleased()
+{
+#ifndef QT_NO_DEBUG
+    if (m_attached.isEmpty()) {
+        return;
+    }
+
+    const QList<QPointer<QObject> > attached(m_attached);
+    const ImageMemory::Owner owner = m_owner;
+    m_attached.clear();
+    if (!QCoreApplication::instance()) {
+        return;
+    }
+
+    // 对象可能是 deleteLater() 释放的，等回到事件循环后再检查
+    QTimer::singleShot(0, QCoreApplication::instance(), [attached, owner]() {
+        for (const QPointer<QObject> &object : attached) {
+            if (object) {
+                qCritical() << object->metaObject()->className() << "outlived the"
+                            << ImageMemory::ownerName(owner) << "image it was created for";
+            }
+            Q_ASSERT_X(object.isNull(), "ImageMemoryTicket", "object outlived its image");
+        }
+    });
+#endif // QT_NO_DEBUG
+}
@@ -0,0 +1,89 @@
+#ifndef IMAGEMEMORY_H
+#define IMAGEMEMORY_H
+
+#include <QList>
+#include <QMutex>
+#include <QPointer>
+
+QT_BEGIN_NAMESPACE
+class QImage;
+class QPixmap;
+QT_END_NAMESPACE
+
+/**
+ * @brief 按持有者统计查看器中图片占用的内存，记录当前值和峰值
+ *
+ * 导航图与主视图共用同一个场景，不单独持有图片，所以没有单独的分类。
+ */
+class ImageMemory
+{
+public:
+    enum Owner {
+        Scene,     // 正在显示的图片/动图
+        Cache,     // 图库缩略图
+        Slideshow, // 幻灯片预先解码的帧
+        Clipboard, // 复制到剪贴板时生成的数据
+        Export,    // 正在导出的图片
+        Texture,   // OpenGL 视口上传的纹理(包括 mipmap)
+        OwnerCount
+    };
+
+    static ImageMemory *instance();
+
+    static qint64 bytesOf(const QImage &image);
+    static qint64 bytesOf(const QPixmap &pixmap);
+    static const char *ownerName(Owner owner);
+
+    qint64 liveBytes(Owner owner) const;
+    qint64 peakBytes(Owner owner) const;
+    qint64 liveBytes() const;
+    qint64 peakBytes() const;
+
+    // 每隔 intervalMs 毫秒向 filePath 追加一行 CSV，用于长时间运行时绘制内存曲线
+    bool startLogging(const QString &filePath, int intervalMs = 5000);
+
+private:
+    friend class ImageMemoryTicket;
+
+    ImageMemory() = default;
+
+    void adjust(Owner owner, qint64 delta);
+
+    mutable QMutex m_mutex;
+    qint64 m_live[OwnerCount] = {};
+    qint64 m_peak[OwnerCount] = {};
+    qint64 m_totalLive = 0;
+    qint64 m_totalPeak = 0;
+};
+
+/**
+ * @brief 一份图片内存的记账凭据，析构时自动注销
+ *
+ * debug 构建下，attach() 的对象应当在图片被替换或释放时一起销毁，否则触发断言。
+ */
+class ImageMemoryTicket
+{
+public:
+    explicit ImageMemoryTicket(ImageMemory::Owner owner, qint64 bytes = 0);
+    ~ImageMemoryTicket();
+
+    // 同一份图片数据的大小发生变化
+    void setBytes(qint64 bytes);
+    // 换成了新的图片，之前 attach 的对象应该已经销毁
+    void reset(qint64 bytes = 0);
+    void attach(QObject *object);
+    qint64 bytes() const { return m_bytes; }
+
+private:
+    Q_DISABLE_COPY(ImageMemoryTicket)
+
+    void checkAttachedReleased();
+
+    ImageMemory::Owner m_owner;
+    qint64 m_bytes = 0;
+#ifndef QT_NO_DEBUG
+    QList<QPointer<QObject> > m_attached;
+#endif // QT_NO_DEBUG
+};
+
+#endif // IMAGEMEMORY_H
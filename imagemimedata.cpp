@@ -0,0 +1,119 @@
+#include "imagemimedata.h"
+
+#include "formatdispatcher.h"
+#include "imageloader.h"
+
+#include <QBuffer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageWriter>
+#include <QUrl>
+
+namespace {
+
+const QString QtImageMimeType = QStringLiteral("application/x-qt-image");
+
+QByteArray formatForMimeType(const QString &mimeType)
+{
+    if (mimeType == QLatin1String("image/png")) {
+        return "png";
+    } else if (mimeType == QLatin1String("image/jpeg")) {
+        return "jpeg";
+    }
+    return QByteArray();
+}
+
+} // namespace
+
+ImageMimeData::ImageMimeData(const QString &filePath, const QPixmap &pixmap)
+    : QMimeData()
+    , m_filePath(filePath)
+    , m_pixmap(pixmap)
+{
+    if (!m_filePath.isEmpty()) {
+        QFileInfo info(m_filePath);
+        m_originalSize = info.size();
+        m_originalLastModified = info.lastModified();
+        m_originalFormat = FormatDispatcher::instance()->sniff(m_filePath).format;
+        setUrls({ QUrl::fromLocalFile(m_filePath) });
+    }
+}
+
+QStringList ImageMimeData::formats() const
+{
+    QStringList result;
+    // 原文件的格式放在最前面，粘贴的一方优先选择它时可以直接使用原文件
+    if (m_originalFormat == "jpeg") {
+        result << QStringLiteral("image/jpeg") << QStringLiteral("image/png");
+    } else {
+        result << QStringLiteral("image/png") << QStringLiteral("image/jpeg");
+    }
+    result << QtImageMimeType;
+    result << QMimeData::formats();
+    return result;
+}
+
+QVariant ImageMimeData::retrieveData(const QString &mimeType, QVariant::Type type) const
+{
+    if (mimeType == QtImageMimeType) {
+        return image();
+    }
+
+    const QByteArray format = formatForMimeType(mimeType);
+    if (!format.isEmpty()) {
+        return encodedData(format);
+    }
+
+    return QMimeData::retrieveData(mimeType, type);
+}
+
+bool ImageMimeData::isOriginalUnchanged() const
+{
+    if (m_filePath.isEmpty()) {
+        return false;
+    }
+
+    QFileInfo info(m_filePath);
+    return info.exists() && info.size() == m_originalSize && info.lastModified() == m_originalLastModified;
+}
+
+QByteArray ImageMimeData::encodedData(const QByteArray &format) const
+{
+    if (m_encoded.contains(format)) {
+        return m_encoded.value(format);
+    }
+
+    QByteArray data;
+
+    if (format == m_originalFormat && isOriginalUnchanged()) {
+        QFile file(m_filePath);
+        if (file.open(QIODevice::ReadOnly)) {
+            data = file.readAll();
+        }
+    }
+
+    if (data.isEmpty()) {
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::WriteOnly);
+        QImageWriter writer(&buffer, format);
+        writer.write(image());
+    }
+
+    m_encoded.insert(format, data);
+    m_memory.setBytes(m_memory.bytes() + data.size());
+    return data;
+}
+
+QImage ImageMimeData::image() const
+{
+    if (m_image.isNull()) {
+        if (m_pixmap.isNull()) {
+            m_image = ImageLoader::decode(m_filePath);
+            m_memory.setBytes(m_memory.bytes() + ImageMemory::bytesOf(m_image));
+        } else {
+            // 与正在显示的图片共享数据，不重复计算
+            m_image = m_pixmap.toImage();
+        }
+    }
+    return m_image;
+}
@@ -0,0 +1,46 @@
+#ifndef IMAGEMIMEDATA_H
+#define IMAGEMIMEDATA_H
+
+#include "imagememory.h"
+
+#include <QDateTime>
+#include <QHash>
+#include <QImage>
+#include <QMimeData>
+#include <QPixmap>
+
+/**
+ * @brief 复制图片到剪贴板时使用的 QMimeData
+ *
+ * 只声明可以提供的格式，真正粘贴时才生成数据。原文件没有被改动并且格式相同时，
+ * 直接提供原文件的内容，否则按需编码。
+ */
+class ImageMimeData : public QMimeData
+{
+    Q_OBJECT
+public:
+    // pixmap 为空时按需从 filePath 解码
+    ImageMimeData(const QString &filePath, const QPixmap &pixmap);
+
+    QStringList formats() const override;
+
+protected:
+    QVariant retrieveData(const QString &mimeType, QVariant::Type type) const override;
+
+private:
+    bool isOriginalUnchanged() const;
+    QByteArray encodedData(const QByteArray &format) const;
+    QImage image() const;
+
+    QString    m_filePath;
+    QByteArray m_originalFormat;
+    qint64     m_originalSize = -1;
+    QDateTime  m_originalLastModified;
+    QPixmap    m_pixmap;
+
+    mutable QImage m_image;
+    mutable QHash<QByteArray, QByteArray> m_encoded;
+    mutable ImageMemoryTicket m_memory { ImageMemory::Clipboard };
+};
+
+#endif // IMAGEMIMEDATA_H
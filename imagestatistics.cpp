@@ -0,0 +1,132 @@
+#include "imagestatistics.h"
+
+#include "taskscheduler.h"
+
+#include <QThread>
+#include <QVector>
+#include <QtConcurrent>
+
+#include <cstring>
+
+namespace {
+
+struct Band
+{
+    QImage image;
+    QRect  rect;
+};
+
+// 每个像素的三次直方图累加是分散写入，无法向量化；这里用四组交替的子直方图
+// 打断相邻像素落在同一个桶时的读写依赖，再把图片分成多块在多个核心上同时统计
+ImageStatistics computeBand(const Band &band)
+{
+    quint32 banks[4][ImageStatistics::ChannelCount][256];
+    memset(banks, 0, sizeof(banks));
+
+    const int left = band.rect.left();
+    const int width = band.rect.width();
+    for (int y = band.rect.top(); y <= band.rect.bottom(); y++) {
+        const QRgb *line = reinterpret_cast<const QRgb *>(band.image.constScanLine(y)) + left;
+        int x = 0;
+        for (; x + 4 <= width; x += 4) {
+            for (int bank = 0; bank < 4; bank++) {
+                const QRgb pixel = line[x + bank];
+                banks[bank][ImageStatistics::Red][qRed(pixel)]++;
+                banks[bank][ImageStatistics::Green][qGreen(pixel)]++;
+                banks[bank][ImageStatistics::Blue][qBlue(pixel)]++;
+            }
+        }
+        for (; x < width; x++) {
+            const QRgb pixel = line[x];
+            banks[0][ImageStatistics::Red][qRed(pixel)]++;
+            banks[0][ImageStatistics::Green][qGreen(pixel)]++;
+            banks[0][ImageStatistics::Blue][qBlue(pixel)]++;
+        }
+    }
+
+    ImageStatistics result;
+    for (int channel = 0; channel < ImageStatistics::ChannelCount; channel++) {
+        for (int i = 0; i < 256; i++) {
+            result.channels[channel].histogram[i] = banks[0][channel][i] + banks[1][channel][i]
+                                                  + banks[2][channel][i] + banks[3][channel][i];
+        }
+    }
+    result.pixelCount = qint64(band.rect.width()) * band.rect.height();
+
+    return result;
+}
+
+void mergeBand(ImageStatistics &result, const ImageStatistics &band)
+{
+    if (result.pixelCount == 0) {
+        result = band;
+        return;
+    }
+
+    for (int channel = 0; channel < ImageStatistics::ChannelCount; channel++) {
+        for (int i = 0; i < 256; i++) {
+            result.channels[channel].histogram[i] += band.channels[channel].histogram[i];
+        }
+    }
+    result.pixelCount += band.pixelCount;
+}
+
+ImageStatistics finalize(ImageStatistics statistics, const QRect &region)
+{
+    statistics.region = region;
+    if (statistics.pixelCount == 0) {
+        return statistics;
+    }
+
+    for (ChannelStatistics &channel : statistics.channels) {
+        double sum = 0;
+        channel.min = -1;
+        for (int i = 0; i < 256; i++) {
+            if (channel.histogram[i] == 0) {
+                continue;
+            }
+            if (channel.min < 0) {
+                channel.min = i;
+            }
+            channel.max = i;
+            sum += double(i) * channel.histogram[i];
+        }
+        channel.mean = sum / statistics.pixelCount;
+        channel.clippedLow = 100.0 * channel.histogram[0] / statistics.pixelCount;
+        channel.clippedHigh = 100.0 * channel.histogram[255] / statistics.pixelCount;
+    }
+
+    return statistics;
+}
+
+} // namespace
+
+QFuture<ImageStatistics> ImageStatistics::compute(const QImage &image, const QRect &region)
+{
+    const QRect rect = region.isEmpty() ? image.rect() : (region & image.rect());
+
+    return TaskScheduler::instance()->run(TaskScheduler::Interaction, [image, rect]() {
+        // 只转换需要统计的区域
+        QImage source;
+        QRect sourceRect = rect;
+        if (image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32) {
+            source = image;
+        } else {
+            source = image.copy(rect).convertToFormat(QImage::Format_ARGB32);
+            sourceRect = source.rect();
+        }
+
+        const int bandCount = qMax(1, QThread::idealThreadCount() * 2);
+        const int bandHeight = qMax(16, (sourceRect.height() + bandCount - 1) / bandCount);
+        QVector<Band> bands;
+        for (int y = sourceRect.top(); y <= sourceRect.bottom(); y += bandHeight) {
+            Band band;
+            band.image = source;
+            band.rect = QRect(sourceRect.left(), y, sourceRect.width(), qMin(bandHeight, sourceRect.bottom() - y + 1));
+            bands.append(band);
+        }
+
+        // 调用线程也会参与计算，在线程池中嵌套使用不会死锁
+        return finalize(QtConcurrent::blockingMappedReduced(bands, computeBand, mergeBand), rect);
+    });
+}
@@ -0,0 +1,37 @@
+#ifndef IMAGESTATISTICS_H
+#define IMAGESTATISTICS_H
+
+#include <QFuture>
+#include <QImage>
+#include <QRect>
+
+struct ChannelStatistics
+{
+    quint32 histogram[256] = {};
+    int     min = 0;
+    int     max = 0;
+    double  mean = 0;
+    double  clippedLow = 0;  // 值为 0 的像素所占的百分比
+    double  clippedHigh = 0; // 值为 255 的像素所占的百分比
+};
+
+struct ImageStatistics
+{
+    enum Channel {
+        Red,
+        Green,
+        Blue,
+        ChannelCount
+    };
+
+    ChannelStatistics channels[ChannelCount];
+    qint64 pixelCount = 0;
+    QRect  region;
+
+    bool isValid() const { return pixelCount > 0; }
+
+    // 在线程池中按行分块并行统计，region 为空时统计整张图片
+    static QFuture<ImageStatistics> compute(const QImage &image, const QRect &region = QRect());
+};
+
+#endif // IMAGESTATISTICS_H
@@ -0,0 +1,206 @@
+#include "jpegorientation.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QSaveFile>
+#include <QtEndian>
+
+namespace {
+
+const quint16 TagOrientation = 0x0112;
+const quint16 TypeShort = 3;
+
+// 顺时针旋转 90° 之后的 EXIF 方向，下标为原来的方向
+const quint16 RotatedClockwise[9] = { 0, 6, 7, 8, 5, 2, 3, 4, 1 };
+
+struct Location
+{
+    bool    hasExif = false;
+    qint64  orientationOffset = -1; // 方向值在文件中的位置
+    bool    littleEndian = false;
+    quint16 orientation = 1;
+    qint64  insertOffset = 2;       // 没有 EXIF 时新段的插入位置
+};
+
+quint16 u16(const uchar *data, bool littleEndian)
+{
+    return littleEndian ? qFromLittleEndian<quint16>(data) : qFromBigEndian<quint16>(data);
+}
+
+quint32 u32(const uchar *data, bool littleEndian)
+{
+    return littleEndian ? qFromLittleEndian<quint32>(data) : qFromBigEndian<quint32>(data);
+}
+
+// 在 IFD0 中查找方向标签，返回值相对 TIFF 头的偏移，没有时返回 -1
+int findOrientation(const QByteArray &tiff, bool *littleEndian, quint16 *orientation)
+{
+    if (tiff.size() < 8) {
+        return -1;
+    }
+    const uchar *data = reinterpret_cast<const uchar *>(tiff.constData());
+    if (data[0] == 'I' && data[1] == 'I') {
+        *littleEndian = true;
+    } else if (data[0] == 'M' && data[1] == 'M') {
+        *littleEndian = false;
+    } else {
+        return -1;
+    }
+    if (u16(data + 2, *littleEndian) != 42) {
+        return -1;
+    }
+
+    const quint32 size = quint32(tiff.size());
+    const quint32 ifd = u32(data + 4, *littleEndian);
+    if (ifd > size - 2) {
+        return -1;
+    }
+    const quint32 count = u16(data + ifd, *littleEndian);
+    for (quint32 i = 0; i < count; i++) {
+        const quint32 entry = ifd + 2 + i * 12;
+        if (entry + 12 > size) {
+            return -1;
+        }
+        if (u16(data + entry, *littleEndian) != TagOrientation) {
+            continue;
+        }
+        if (u16(data + entry + 2, *littleEndian) != TypeShort || u32(data + entry + 4, *littleEndian) != 1) {
+            return -1;
+        }
+        *orientation = u16(data + entry + 8, *littleEndian);
+        return int(entry + 8);
+    }
+    return -1;
+}
+
+// 只读取 SOS 之前的元数据段，不读取图像数据
+bool locate(QIODevice *device, Location *location)
+{
+    uchar soi[2];
+    if (device->read(reinterpret_cast<char *>(soi), 2) != 2 || soi[0] != 0xFF || soi[1] != 0xD8) {
+        return false;
+    }
+
+    qint64 pos = 2;
+    for (;;) {
+        uchar marker[4];
+        if (!device->seek(pos) || device->read(reinterpret_cast<char *>(marker), 4) != 4 || marker[0] != 0xFF) {
+            return false;
+        }
+        // 标记之前可以有任意个 0xFF 填充字节
+        if (marker[1] == 0xFF) {
+            pos++;
+            continue;
+        }
+        // SOS 和 EOI 之后不会再有 EXIF
+        if (marker[1] == 0xDA || marker[1] == 0xD9) {
+            return true;
+        }
+
+        const quint16 length = qFromBigEndian<quint16>(marker + 2);
+        if (length < 2) {
+            return false;
+        }
+        // JFIF 要求 APP0 是第一个段，新的 EXIF 段放在它之后
+        if (marker[1] == 0xE0 && pos == 2) {
+            location->insertOffset = pos + 2 + length;
+        }
+        if (marker[1] == 0xE1 && !location->hasExif) {
+            const QByteArray segment = device->read(length - 2);
+            if (segment.size() != length - 2) {
+                return false;
+            }
+            if (segment.startsWith(QByteArray("Exif\0\0", 6))) {
+                location->hasExif = true;
+                const int offset = findOrientation(segment.mid(6), &location->littleEndian, &location->orientation);
+                if (offset >= 0) {
+                    location->orientationOffset = pos + 4 + 6 + offset;
+                }
+            }
+        }
+        pos += 2 + length;
+    }
+}
+
+bool fail(QString *errorString, const QString &message)
+{
+    if (errorString) {
+        *errorString = message;
+    }
+    return false;
+}
+
+} // namespace
+
+bool JpegOrientation::rotate(const QString &filePath, int quarterTurns, QString *errorString)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadWrite)) {
+        return fail(errorString, file.errorString());
+    }
+
+    Location location;
+    if (!locate(&file, &location)) {
+        return fail(errorString, QCoreApplication::translate("JpegOrientation", "Not a valid JPEG file."));
+    }
+
+    quint16 orientation = location.orientation >= 1 && location.orientation <= 8 ? location.orientation : 1;
+    const int turns = (quarterTurns % 4 + 4) % 4;
+    for (int i = 0; i < turns; i++) {
+        orientation = RotatedClockwise[orientation];
+    }
+
+    if (location.orientationOffset >= 0) {
+        // 值的长度不变，原地改写
+        uchar value[2];
+        if (location.littleEndian) {
+            qToLittleEndian(orientation, value);
+        } else {
+            qToBigEndian(orientation, value);
+        }
+        if (!file.seek(location.orientationOffset)
+                || file.write(reinterpret_cast<const char *>(value), 2) != 2 || !file.flush()) {
+            return fail(errorString, file.errorString());
+        }
+        return true;
+    }
+
+    // 在已有的 EXIF 中加入标签需要移动后面所有的偏移，不处理这种少见的情况
+    if (location.hasExif) {
+        return fail(errorString, QCoreApplication::translate("JpegOrientation",
+                                                             "The EXIF data of this file has no orientation tag."));
+    }
+    if (turns == 0) {
+        return true;
+    }
+
+    // 插入只包含 IFD0 和一个方向标签的 EXIF 段
+    const uchar segment[] = {
+        0xFF, 0xE1, 0x00, 0x22,                                   // APP1，长度 34
+        'E', 'x', 'i', 'f', 0x00, 0x00,
+        'M', 'M', 0x00, 0x2A, 0x00, 0x00, 0x00, 0x08,             // TIFF 头，IFD0 紧随其后
+        0x00, 0x01,                                               // 1 个标签
+        0x01, 0x12, 0x00, 0x03, 0x00, 0x00, 0x00, 0x01,           // 方向，SHORT × 1
+        0x00, uchar(orientation), 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00                                    // 没有下一个 IFD
+    };
+
+    if (!file.seek(0)) {
+        return fail(errorString, file.errorString());
+    }
+    const QByteArray data = file.readAll();
+    file.close();
+
+    // 先写到临时文件，中途失败时原文件不受影响
+    QSaveFile saveFile(filePath);
+    if (!saveFile.open(QIODevice::WriteOnly)) {
+        return fail(errorString, saveFile.errorString());
+    }
+    saveFile.write(data.constData(), location.insertOffset);
+    saveFile.write(reinterpret_cast<const char *>(segment), sizeof(segment));
+    saveFile.write(data.constData() + location.insertOffset, data.size() - location.insertOffset);
+    if (!saveFile.commit()) {
+        return fail(errorString, saveFile.errorString());
+    }
+    return true;
+}
@@ -0,0 +1,19 @@
+#ifndef JPEGORIENTATION_H
+#define JPEGORIENTATION_H
+
+#include <QString>
+
+/**
+ * @brief 通过改写 EXIF 方向标签无损旋转 JPEG 文件
+ *
+ * 不解码也不重新编码图像数据。文件已有方向标签时只原地改写这两个字节；
+ * 没有 EXIF 时插入一个只含方向标签的 APP1 段。
+ */
+class JpegOrientation
+{
+public:
+    // quarterTurns 为顺时针旋转 90° 的次数，负数表示逆时针。失败时文件保持不变
+    static bool rotate(const QString &filePath, int quarterTurns, QString *errorString = nullptr);
+};
+
+#endif // JPEGORIENTATION_H
@@ -1,44 +1,110 @@
 #include "mainwindow.h"
+#include "batchconverter.h"
+#include "imagememory.h"
+#include "settings.h"
+#include "shutdown.h"
+#include "singleinstance.h"
+#include "startuptimer.h"
+#include "taskscheduler.h"
 #include <QApplication>
 #include <QCommandLineParser>
 #include <QDir>
+#include <QFileInfo>
+#include <QImageReader>
 #include <QTranslator>
 #include <QUrl>
 #include <QDebug>
 
 int main(int argc, char *argv[])
 {
+    // 批量转换模式不需要窗口
+    if (BatchConverter::isRequested(argc, argv)) {
+        return BatchConverter::exec(argc, argv);
+    }
+
+    StartupTimer::instance()->start();
+
     QApplication a(argc, argv);
+    StartupTimer::instance()->mark("application");
+
+    // 在后台线程预先加载图片格式插件，使首次解码不必再等待插件加载
+    TaskScheduler::instance()->run(TaskScheduler::Metadata, []() {
+        QImageReader::supportedImageFormats();
+    });
 
     QTranslator translator;
     QString qmDir;
     qmDir = QT_STRINGIFY(QM_FILE_INSTALL_DIR);
     translator.load(QString("PineapplePictures_%1").arg(QLocale::system().name()), qmDir);
     a.installTranslator(&translator);
+    StartupTimer::instance()->mark("translations");
 
     // parse commandline arguments
     QCommandLineParser parser;
     parser.addPositionalArgument("File list", QCoreApplication::translate("main", "File list."));
+    QCommandLineOption startupTimingsOption("startup-timings",
+                                            QCoreApplication::translate("main", "Print the time spent in each start-up phase."));
+    parser.addOption(startupTimingsOption);
+    QCommandLineOption memoryLogOption("memory-log",
+                                       QCoreApplication::translate("main", "Append image memory usage to <file> every few seconds."),
+                                       "file");
+    parser.addOption(memoryLogOption);
     parser.addHelpOption();
 
     parser.process(a);
 
+    StartupTimer::instance()->setReportEnabled(parser.isSet(startupTimingsOption));
+    if (parser.isSet(memoryLogOption)) {
+        ImageMemory::instance()->startLogging(parser.value(memoryLogOption));
+    }
+
     QStringList urlStrList = parser.positionalArguments();
     QList<QUrl> urlList;
     for (const QString & str : urlStrList) {
-        QUrl url = QUrl::fromLocalFile(str);
+        // 使用绝对路径，文件列表可能会交给工作目录不同的其它实例
+        QUrl url = QUrl::fromLocalFile(QFileInfo(str).absoluteFilePath());
         if (url.isValid()) {
             urlList.append(url);
         }
     }
 
+    SingleInstance singleInstance;
+    if (Settings::instance()->singleInstance()) {
+        if (SingleInstance::sendToRunningInstance(urlList)) {
+            return 0;
+        }
+        singleInstance.listen();
+        QObject::connect(&a, &QCoreApplication::aboutToQuit, &singleInstance, &SingleInstance::close);
+    }
+
+    StartupTimer::instance()->mark("arguments");
+
     MainWindow w;
+    StartupTimer::instance()->mark("main window");
     w.show();
+    StartupTimer::instance()->mark("show");
 
     if (!urlList.isEmpty()) {
         w.showUrls(urlList);
         w.adjustWindowSizeBySceneRect();
+        StartupTimer::instance()->mark("first image");
     }
 
-    return a.exec();
+    StartupTimer::instance()->reportAfterFirstPaint(w.centralWidget());
+
+    QObject::connect(&singleInstance, &SingleInstance::urlsReceived,
+                     &w, [&w](const QList<QUrl> &urls) {
+        // 复用已有的窗口，解码插件等都已经加载好了
+        if (!urls.isEmpty()) {
+            w.showUrls(urls);
+            w.adjustWindowSizeBySceneRect();
+        }
+        w.setWindowState(w.windowState() & ~Qt::WindowMinimized);
+        w.show();
+        w.raise();
+        w.activateWindow();
+    });
+
+    // 不再析构窗口、场景和缓存，大块内存由操作系统一次性回收
+    Shutdown::exitProcess(a.exec());
 }
@@ -4,15 +4,27 @@
 #include "toolbutton.h"
 
 #include "bottombuttongroup.h"
+#include "compareview.h"
 #include "graphicsview.h"
 #include "navigatorview.h"
 #include "graphicsscene.h"
 #include "settingsdialog.h"
+#include "slideshow.h"
+#include "formatdispatcher.h"
+#include "navigationloader.h"
+#include "imagemimedata.h"
+#include "imageexporter.h"
+#include "histogramview.h"
+#include "pageloader.h"
+#include "taskscheduler.h"
+#include "imageloader.h"
+#include "jpegorientation.h"
 
 #include <QScreen>
 #include <QDebug>
 #include <QStyle>
 #include <QMouseEvent>
+#include <QCloseEvent>
 #include <QGraphicsScene>
 #include <QApplication>
 #include <QGraphicsTextItem>
@@ -22,6 +34,55 @@
 #include <QCollator>
 #include <QClipboard>
 #include <QMimeData>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QProgressDialog>
+#include <QFutureWatcher>
+
+namespace {
+
+const QStringList galleryNameFilters {
+    "*.jpg", "*.jpeg", "*.jfif", "*.png", "*.gif", "*.svg", "*.bmp",
+    "*.cr2", "*.nef", "*.nrw", "*.arw", "*.srf", "*.sr2", "*.dng"
+};
+
+QStringList sortedGalleryEntries(const QDir &dir)
+{
+    QStringList entryList = dir.entryList(galleryNameFilters, QDir::Files | QDir::NoSymLinks, QDir::NoSort);
+
+    QCollator collator;
+    collator.setNumericMode(true);
+
+    std::sort(entryList.begin(), entryList.end(), collator);
+
+    return entryList;
+}
+
+// 在后台线程展开拖入的文件夹，并且只通过文件头检查文件是否为图片
+QList<QUrl> expandDroppedUrls(const QList<QUrl> &urls)
+{
+    QList<QUrl> result;
+
+    for (const QUrl &url : urls) {
+        const QString path(url.toLocalFile());
+        QFileInfo info(path);
+        if (info.isDir()) {
+            QDir dir(path);
+            for (const QString &entry : sortedGalleryEntries(dir)) {
+                const QString filePath(dir.absoluteFilePath(entry));
+                if (FormatDispatcher::instance()->sniff(filePath).isValid()) {
+                    result.append(QUrl::fromLocalFile(filePath));
+                }
+            }
+        } else if (info.isFile() && FormatDispatcher::instance()->sniff(path).isValid()) {
+            result.append(url);
+        }
+    }
+
+    return result;
+}
+
+} // namespace
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
@@ -37,52 +98,160 @@ MainWindow::MainWindow(QWidget *parent)
     this->setWindowIcon(QIcon(":/icons/app-icon.svg"));
     this->setMouseTracking(true);
 
-    // 与窗口透明度属性绑定
-    m_fadeOutAnimation = new QPropertyAnimation(this, "windowOpacity");
-    m_fadeOutAnimation->setDuration(300);
-    m_fadeOutAnimation->setStartValue(1);
-    m_fadeOutAnimation->setEndValue(0);
-    // 与窗口geometry属性绑定
-    m_floatUpAnimation = new QPropertyAnimation(this, "geometry");
-    m_floatUpAnimation->setDuration(300);
-    m_floatUpAnimation->setEasingCurve(QEasingCurve::OutCirc);
-
-    m_exitAnimationGroup = new QParallelAnimationGroup(this);
-    m_exitAnimationGroup->addAnimation(m_fadeOutAnimation);
-    m_exitAnimationGroup->addAnimation(m_floatUpAnimation);
-    connect(m_exitAnimationGroup, &QParallelAnimationGroup::finished,
-            this, &MainWindow::close);
-
     GraphicsScene *scene = new GraphicsScene(this);
 
     m_graphicsView = new GraphicsView(this);
     m_graphicsView->setScene(scene);
+    m_graphicsView->setOpenGLEnabled(Settings::instance()->openGLViewport());
     this->setCentralWidget(m_graphicsView);
 
-    m_gv = new NavigatorView(this);
-    m_gv->setFixedSize(220, 160);
-    m_gv->setScene(scene);
-    m_gv->setMainView(m_graphicsView);
-    m_gv->fitInView(m_gv->sceneRect(), Qt::KeepAspectRatio);
-
-    connect(m_graphicsView, &GraphicsView::navigatorViewRequired,
-            this, [ = ](bool required, qreal angle) {
-        m_gv->resetTransform();
-        m_gv->rotate(angle);
-        m_gv->fitInView(m_gv->sceneRect(), Qt::KeepAspectRatio);
-        m_gv->setVisible(required);
-        m_gv->updateMainViewportRegion();
+    connect(Settings::instance(), &Settings::openGLViewportChanged, this, [this](bool on) {
+        m_graphicsView->setOpenGLEnabled(on);
+        if (m_gv) {
+            m_gv->setOpenGLEnabled(on);
+        }
     });
 
-    connect(m_graphicsView, &GraphicsView::viewportRectChanged,
-            m_gv, &NavigatorView::updateMainViewportRegion);
+    connect(m_graphicsView, &GraphicsView::viewStateChanged,
+            this, [ = ](const QTransform &transform, bool required, qreal angle) {
+        Q_UNUSED(transform);
+        m_navigatorRequired = required;
+        m_navigatorAngle = angle;
+        if (m_gv) {
+            updateNavigatorView();
+        }
+        updateHistogram();
+    });
 
     connect(m_graphicsView, &GraphicsView::requestGallery,
             this, &MainWindow::loadGalleryBySingleLocalFile);
+    connect(m_graphicsView, &GraphicsView::requestGalleryFromUrls,
+            this, &MainWindow::loadGalleryByUrls);
+
+    m_navigationLoader = new NavigationLoader(this);
+
+    connect(m_navigationLoader, &NavigationLoader::previewReady,
+            this, [this](const QUrl &url, const QImage &thumbnail, const QSize &originalSize) {
+        // 已经翻到其它页时，第一页的结果不再显示
+        if (url != currentImageFileUrl() || m_pageLoader->currentPage() != 0) {
+            return;
+        }
+        // 原图解码完成之前，先按最终的显示大小显示缩略图
+        QSize viewSize(m_graphicsView->rect().size());
+        QSize displaySize(originalSize);
+        if (displaySize.width() > viewSize.width() || displaySize.height() > viewSize.height()) {
+            displaySize.scale(viewSize, Qt::KeepAspectRatio);
+        }
+        m_graphicsView->showImage(thumbnail.scaled(displaySize, Qt::IgnoreAspectRatio, Qt::FastTransformation));
+        m_previewPixmapKey = m_graphicsView->scene()->currentPixmap().cacheKey();
+    });
+
+    connect(m_navigationLoader, &NavigationLoader::imageReady,
+            this, [this](const QUrl &url, const QImage &image, const QSize &fullSize) {
+        if (url != currentImageFileUrl() || m_pageLoader->currentPage() != 0) {
+            return;
+        }
+        if (image.isNull()) {
+            // 由 GraphicsView 显示错误信息
+            m_graphicsView->showFileFromUrl(url, false);
+        } else if (fullSize != image.size()) {
+            m_graphicsView->showOverview(image, url.toLocalFile(), fullSize);
+        } else {
+            m_graphicsView->showImage(image);
+        }
+    });
+
+    connect(m_navigationLoader, &NavigationLoader::directLoadRequired,
+            this, [this](const QUrl &url) {
+        m_graphicsView->showFileFromUrl(url, false);
+    });
+
+    m_pageLoader = new PageLoader(this);
+
+    connect(m_pageLoader, &PageLoader::pagesCounted,
+            this, [this](const QUrl &url, int count) {
+        Q_UNUSED(url);
+        updatePageIndicator();
+        // 只有一个文件时也可以用前后按钮翻页
+        if (count > 1 && m_prevButton && !m_protectMode) {
+            m_prevButton->setVisible(true);
+            m_nextButton->setVisible(true);
+        }
+    });
+
+    connect(m_pageLoader, &PageLoader::pageReady,
+            this, [this](const QUrl &url, int page, const QImage &image) {
+        Q_UNUSED(url);
+        Q_UNUSED(page);
+        if (image.isNull()) {
+            m_graphicsView->showText(tr("File not is a valid image"));
+        } else {
+            m_graphicsView->showImage(image);
+        }
+    });
+
+    connect(this, &MainWindow::galleryLoaded, this, [this]() {
+        if (m_prevButton) {
+            m_prevButton->setVisible(isGalleryAvailable());
+            m_nextButton->setVisible(isGalleryAvailable());
+        }
+    });
+
+    QShortcut *quitAppShortCut = new QShortcut(QKeySequence(Qt::Key_Space), this);
+    connect(quitAppShortCut, &QShortcut::activated, this, std::bind(&MainWindow::quitAppAction, this, false));
+
+    QShortcut *quitAppShortCut2 = new QShortcut(QKeySequence(Qt::Key_Escape), this);
+    connect(quitAppShortCut2, &QShortcut::activated, this, std::bind(&MainWindow::quitAppAction, this, false));
+
+
+    QShortcut * prevPictureShorucut = new QShortcut(QKeySequence(Qt::Key_PageUp), this);
+    connect(prevPictureShorucut, &QShortcut::activated,
+            this, &MainWindow::galleryPrev);
+
+    QShortcut * nextPictureShorucut = new QShortcut(QKeySequence(Qt::Key_PageDown), this);
+    connect(nextPictureShorucut, &QShortcut::activated,
+            this, &MainWindow::galleryNext);
+
+    QShortcut * fullscreenShorucut = new QShortcut(QKeySequence(QKeySequence::FullScreen), this);
+    connect(fullscreenShorucut, &QShortcut::activated,
+            this, &MainWindow::toggleFullscreen);
+
+    QShortcut * slideshowShorucut = new QShortcut(QKeySequence(Qt::Key_F5), this);
+    connect(slideshowShorucut, &QShortcut::activated,
+            this, &MainWindow::toggleSlideshow);
+
+    QShortcut * hudShorucut = new QShortcut(QKeySequence(Qt::Key_F12), this);
+    connect(hudShorucut, &QShortcut::activated,
+            m_graphicsView, &GraphicsView::toggleHud);
+
+    QShortcut * histogramShorucut = new QShortcut(QKeySequence(Qt::Key_H), this);
+    connect(histogramShorucut, &QShortcut::activated,
+            this, &MainWindow::toggleHistogram);
+
+    centerWindow();
+}
+
+MainWindow::~MainWindow()
+{
+}
+
+void MainWindow::ensureChromeCreated()
+{
+    if (m_bottomButtonGroup) {
+        return;
+    }
+
+    // 导航图和按钮在鼠标第一次进入窗口时才创建，不占用首帧的时间
+    m_gv = new NavigatorView(this);
+    m_gv->setFixedSize(220, 160);
+    m_gv->setScene(m_graphicsView->scene());
+    m_gv->setMainView(m_graphicsView);
+    m_gv->setOpenGLEnabled(Settings::instance()->openGLViewport());
 
     m_closeButton = new ToolButton(true, m_graphicsView);
     m_closeButton->setIcon(QIcon(":/icons/window-close"));
     m_closeButton->setIconSize(QSize(50, 50));
+    m_closeButton->setVisible(!m_protectMode);
 
     connect(m_closeButton, &QPushButton::clicked,
             this, &MainWindow::closeWindow);
@@ -90,12 +259,12 @@ MainWindow::MainWindow(QWidget *parent)
     m_prevButton = new ToolButton(false, m_graphicsView);
     m_prevButton->setIcon(QIcon(":/icons/go-previous"));
     m_prevButton->setIconSize(QSize(75, 75));
-    m_prevButton->setVisible(false);
+    m_prevButton->setVisible((isGalleryAvailable() || m_pageLoader->pageCount() > 1) && !m_protectMode);
     m_prevButton->setOpacity(0, false);
     m_nextButton = new ToolButton(false, m_graphicsView);
     m_nextButton->setIcon(QIcon(":/icons/go-next"));
     m_nextButton->setIconSize(QSize(75, 75));
-    m_nextButton->setVisible(false);
+    m_nextButton->setVisible((isGalleryAvailable() || m_pageLoader->pageCount() > 1) && !m_protectMode);
     m_nextButton->setOpacity(0, false);
 
     connect(m_prevButton, &QAbstractButton::clicked,
@@ -127,35 +296,222 @@ MainWindow::MainWindow(QWidget *parent)
     m_gv->setOpacity(0, false);
     m_closeButton->setOpacity(0, false);
 
-    connect(this, &MainWindow::galleryLoaded, this, [this]() {
-        m_prevButton->setVisible(isGalleryAvailable());
-        m_nextButton->setVisible(isGalleryAvailable());
-    });
+    m_bottomButtonGroup->show();
+    updateNavigatorView();
+    updateWidgetsPosition();
+}
 
-    QShortcut *quitAppShortCut = new QShortcut(QKeySequence(Qt::Key_Space), this);
-    connect(quitAppShortCut, &QShortcut::activated, this, std::bind(&MainWindow::quitAppAction, this, false));
+void MainWindow::toggleSlideshow()
+{
+    if (!m_slideshow) {
+        m_slideshow = new Slideshow(this);
+
+        connect(m_slideshow, &Slideshow::frameReady, this, [this](int index, const QImage &image, const QSize &displaySize) {
+            m_currentFileIndex = index;
+            const QUrl url(m_files.value(index));
+            // 动图仍然交给 QMovie 播放，解码失败时显示错误信息
+            if (image.isNull() || FormatDispatcher::instance()->sniff(url.toLocalFile()).engine == EngineAnimated) {
+                m_graphicsView->showFileFromUrl(url, false);
+            } else {
+                m_graphicsView->showImage(image);
+                // 降低分辨率解码的帧放大到正常的显示大小，只损失细节，图片大小不跳变
+                if (image.width() < displaySize.width()) {
+                    m_graphicsView->zoomView(qreal(displaySize.width()) / image.width());
+                }
+            }
+        });
 
-    QShortcut *quitAppShortCut2 = new QShortcut(QKeySequence(Qt::Key_Escape), this);
-    connect(quitAppShortCut2, &QShortcut::activated, this, std::bind(&MainWindow::quitAppAction, this, false));
+        connect(m_slideshow, &Slideshow::blendFrameReady, this, [this](const QImage &image) {
+            m_graphicsView->scene()->replacePixmap(QPixmap::fromImage(image));
+        });
 
+        // 播放过程中修改设置立即生效
+        connect(Settings::instance(), &Settings::slideshowIntervalChanged,
+                m_slideshow, &Slideshow::setInterval);
+        connect(Settings::instance(), &Settings::slideshowCrossfadeChanged,
+                m_slideshow, &Slideshow::setCrossfadeEnabled);
+    }
 
-    QShortcut * prevPictureShorucut = new QShortcut(QKeySequence(Qt::Key_PageUp), this);
-    connect(prevPictureShorucut, &QShortcut::activated,
-            this, &MainWindow::galleryPrev);
+    if (m_slideshow->isRunning()) {
+        m_slideshow->stop();
+        // 幻灯片中显示的是按窗口大小缩放过的图片，结束后重新加载原图
+        if (isGalleryAvailable()) {
+            m_graphicsView->showFileFromUrl(m_files.at(m_currentFileIndex), false);
+            openPages(m_files.at(m_currentFileIndex));
+        }
+        return;
+    }
 
-    QShortcut * nextPictureShorucut = new QShortcut(QKeySequence(Qt::Key_PageDown), this);
-    connect(nextPictureShorucut, &QShortcut::activated,
-            this, &MainWindow::galleryNext);
+    if (!isGalleryAvailable()) {
+        return;
+    }
 
-    QShortcut * fullscreenShorucut = new QShortcut(QKeySequence(QKeySequence::FullScreen), this);
-    connect(fullscreenShorucut, &QShortcut::activated,
-            this, &MainWindow::toggleFullscreen);
+    m_navigationLoader->cancel();
+    // 幻灯片只显示每个文件的第一页
+    m_pageLoader->close();
+    updatePageIndicator();
+    m_slideshow->setInterval(Settings::instance()->slideshowInterval());
+    m_slideshow->setCrossfadeEnabled(Settings::instance()->slideshowCrossfade());
+    m_slideshow->start(m_files, m_currentFileIndex, m_graphicsView->viewport()->size());
+}
 
-    centerWindow();
+void MainWindow::showGalleryIndex(int index)
+{
+    // 连续切换时解码请求会被合并，只有最后一张以原始质量加载
+    m_currentFileIndex = index;
+    m_navigationLoader->setGalleryPosition(m_files, index);
+    m_navigationLoader->load(m_files.at(index));
+    openPages(m_files.at(index));
 }
 
-MainWindow::~MainWindow()
+void MainWindow::openPages(const QUrl &url)
+{
+    m_pageLoader->open(url);
+    updatePageIndicator();
+}
+
+void MainWindow::updatePageIndicator()
 {
+    const QString fileName(QFileInfo(m_pageLoader->url().toLocalFile()).fileName());
+    if (m_pageLoader->pageCount() > 1) {
+        setWindowTitle(QStringLiteral("%1 (%2/%3)").arg(fileName)
+                       .arg(m_pageLoader->currentPage() + 1).arg(m_pageLoader->pageCount()));
+    } else {
+        setWindowTitle(fileName);
+    }
+}
+
+void MainWindow::toggleHistogram()
+{
+    if (!m_histogramView) {
+        m_histogramView = new HistogramView(this);
+        m_histogramView->setFixedSize(280, 150);
+        m_histogramView->setVisible(false);
+    }
+
+    m_histogramView->setVisible(!m_histogramView->isVisible());
+    if (m_histogramView->isVisible()) {
+        m_histogramView->move(0, 0);
+        m_histogramView->raise();
+        updateHistogram();
+    } else {
+        m_histogramView->clear();
+    }
+}
+
+void MainWindow::updateHistogram()
+{
+    if (!m_histogramView || !m_histogramView->isVisible()) {
+        return;
+    }
+
+    const QPixmap pixmap(m_graphicsView->scene()->currentPixmap());
+    if (pixmap.isNull()) {
+        m_histogramView->clear();
+        return;
+    }
+
+    // 放大时只统计可见部分；显示概览图时场景坐标是原图的像素坐标，需要换算到概览图上
+    const QSizeF sceneSize(m_graphicsView->sceneRect().size());
+    const QTransform sceneToPixmap(QTransform::fromScale(pixmap.width() / sceneSize.width(),
+                                                         pixmap.height() / sceneSize.height()));
+    const QRect visibleRect(sceneToPixmap.mapRect(m_graphicsView->mapToScene(m_graphicsView->viewport()->rect())
+                                                  .boundingRect()).toAlignedRect());
+    m_histogramView->requestUpdate(pixmap.toImage(), visibleRect);
+}
+
+bool MainWindow::isFullResolution(const QPixmap &pixmap, const QString &filePath) const
+{
+    // 概览图、解码完成之前放大显示的缩略图、幻灯片中缩放过的帧和淡入淡出的混合帧都不是原图
+    return !m_graphicsView->scene()->isOverview()
+            && pixmap.cacheKey() != m_previewPixmapKey
+            && !(m_slideshow && m_slideshow->isRunning())
+            && (m_pageLoader->currentPage() != 0 || pixmap.size() == ImageLoader::imageSize(filePath));
+}
+
+void MainWindow::saveAs()
+{
+    if (m_imageExporter && m_imageExporter->isRunning()) {
+        return;
+    }
+
+    const QString sourcePath(currentImageFileUrl().toLocalFile());
+    QPixmap pixmap(m_graphicsView->scene()->currentPixmap());
+    // 显示的不是完整解码的原图时，导出时在工作线程中解码原图
+    const bool decodeSource = !pixmap.isNull() && !sourcePath.isEmpty() && !isFullResolution(pixmap, sourcePath);
+    if (pixmap.isNull()) {
+        pixmap = m_graphicsView->scene()->renderToPixmap();
+    }
+
+    QFileInfo currentFileInfo(sourcePath);
+    QString defaultPath = currentFileInfo.fileName().isEmpty()
+            ? QDir::home().absoluteFilePath("image.png")
+            : currentFileInfo.dir().absoluteFilePath(currentFileInfo.completeBaseName() + "-export.png");
+
+    QString filePath = QFileDialog::getSaveFileName(this, tr("Save As"), defaultPath,
+                                                    tr("PNG image (*.png);;JPEG image (*.jpg *.jpeg);;WebP image (*.webp)"));
+    if (filePath.isEmpty()) {
+        return;
+    }
+    if (!ImageExporter::supportedSuffixes().contains(QFileInfo(filePath).suffix().toLower())) {
+        filePath += ".png";
+    }
+
+    if (!m_imageExporter) {
+        m_imageExporter = new ImageExporter(this);
+    }
+
+    // 编码在后台进行，进度窗口不阻塞主窗口
+    QProgressDialog *progressDialog = new QProgressDialog(tr("Exporting %1...").arg(QFileInfo(filePath).fileName()),
+                                                          tr("Cancel"), 0, 100, this);
+    progressDialog->setWindowModality(Qt::NonModal);
+    progressDialog->setMinimumDuration(500);
+    progressDialog->setAutoClose(false);
+    progressDialog->setAutoReset(false);
+    progressDialog->setValue(0);
+
+    connect(progressDialog, &QProgressDialog::canceled, m_imageExporter, &ImageExporter::cancel);
+    connect(m_imageExporter, &ImageExporter::progressChanged, progressDialog, [progressDialog](int percent) {
+        if (percent < 0) {
+            progressDialog->setRange(0, 0);
+        } else {
+            // 解码原图之后才开始有编码进度
+            progressDialog->setRange(0, 100);
+            progressDialog->setValue(percent);
+        }
+    });
+    connect(m_imageExporter, &ImageExporter::finished, progressDialog, [this, progressDialog](bool success, const QString &errorString) {
+        progressDialog->deleteLater();
+        if (!success && !progressDialog->wasCanceled()) {
+            QMessageBox::warning(this, tr("Export failed"), errorString);
+        }
+    });
+
+    if (decodeSource) {
+        m_imageExporter->startFromFile(sourcePath, m_graphicsView->rotateAngle(), filePath);
+        return;
+    }
+
+    m_imageExporter->start(pixmap.toImage(), m_graphicsView->rotateAngle(), filePath);
+}
+
+void MainWindow::updateNavigatorView()
+{
+    m_gv->setVisible(m_navigatorRequired);
+    if (!m_navigatorRequired) {
+        return;
+    }
+
+    // 只有旋转角度或图片变化时才需要重新适应，缩放和滚动只更新预览框
+    const QRectF sceneRect(m_gv->sceneRect());
+    if (m_navigatorFittedAngle != m_navigatorAngle || m_navigatorFittedRect != sceneRect) {
+        m_gv->resetTransform();
+        m_gv->rotate(m_navigatorAngle);
+        m_gv->fitInView(sceneRect, Qt::KeepAspectRatio);
+        m_navigatorFittedAngle = m_navigatorAngle;
+        m_navigatorFittedRect = sceneRect;
+    }
+    m_gv->updateMainViewportRegion();
 }
 
 void MainWindow::showUrls(const QList<QUrl> &urls)
@@ -167,13 +523,12 @@ void MainWindow::showUrls(const QList<QUrl> &urls)
             m_graphicsView->showFileFromUrl(urls.first(), false);
             m_files = urls;
             m_currentFileIndex = 0;
+            openPages(urls.first());
         }
     } else {
         m_graphicsView->showText(tr("File url list is empty"));
         return;
     }
-    m_gv->fitInView(m_gv->sceneRect(), Qt::KeepAspectRatio);
-
 }
 
 void MainWindow::adjustWindowSizeBySceneRect()
@@ -196,6 +551,39 @@ void MainWindow::adjustWindowSizeBySceneRect()
     }
 }
 
+void MainWindow::rotateFile(int quarterTurns)
+{
+    const QUrl url(currentImageFileUrl());
+    const QString filePath(url.toLocalFile());
+    if (filePath.isEmpty()) {
+        return;
+    }
+
+    // 写文件在后台进行，完成后只重新加载这一张图片，图库的其它部分不受影响
+    QFutureWatcher<QString> *watcher = new QFutureWatcher<QString>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, url, filePath]() {
+        watcher->deleteLater();
+        const QString errorString(watcher->result());
+        if (!errorString.isEmpty()) {
+            QMessageBox::warning(this, tr("Rotate failed"), errorString);
+            return;
+        }
+
+        FormatDispatcher::instance()->invalidate(filePath);
+        m_navigationLoader->invalidate(filePath);
+        if (currentImageFileUrl() == url) {
+            showGalleryIndex(m_currentFileIndex);
+        }
+    });
+
+    watcher->setFuture(TaskScheduler::instance()->run(TaskScheduler::Interaction, [filePath, quarterTurns]() {
+        // 成功时返回空字符串
+        QString errorString;
+        JpegOrientation::rotate(filePath, quarterTurns, &errorString);
+        return errorString;
+    }));
+}
+
 QUrl MainWindow::currentImageFileUrl()
 {
     if (m_currentFileIndex != -1) {
@@ -206,6 +594,8 @@ QUrl MainWindow::currentImageFileUrl()
 
 void MainWindow::clearGallery()
 {
+    // 正在后台处理的拖放结果作废
+    m_galleryGeneration++;
     m_currentFileIndex = -1;
     m_files.clear();
 }
@@ -215,13 +605,7 @@ void MainWindow::loadGalleryBySingleLocalFile(const QString &path)
     QFileInfo info(path);
     QDir dir(info.path());
     QString currentFileName = info.fileName();
-    QStringList entryList = dir.entryList({"*.jpg", "*.jpeg", ".jfif", "*.png", "*.gif", "*.svg", "*.bmp"},
-                                          QDir::Files | QDir::NoSymLinks, QDir::NoSort);
-
-    QCollator collator;
-    collator.setNumericMode(true);
-
-    std::sort(entryList.begin(), entryList.end(), collator);
+    QStringList entryList = sortedGalleryEntries(dir);
 
     clearGallery();
 
@@ -233,30 +617,95 @@ void MainWindow::loadGalleryBySingleLocalFile(const QString &path)
         }
     }
 
+    openPages(QUrl::fromLocalFile(path));
+
     emit galleryLoaded();
 }
 
+void MainWindow::loadGalleryByUrls(const QList<QUrl> &urls)
+{
+    clearGallery();
+    emit galleryLoaded();
+
+    // 先显示第一个拖入的文件，文件夹的展开和其它文件的检查在后台进行
+    QUrl firstFileUrl;
+    for (const QUrl &url : urls) {
+        if (!QFileInfo(url.toLocalFile()).isDir()) {
+            firstFileUrl = url;
+            break;
+        }
+    }
+
+    if (firstFileUrl.isValid()) {
+        m_graphicsView->showFileFromUrl(firstFileUrl, false);
+        openPages(firstFileUrl);
+    } else {
+        m_graphicsView->showText(tr("Loading..."));
+    }
+
+    const int generation = m_galleryGeneration;
+    QFutureWatcher<QList<QUrl> > *watcher = new QFutureWatcher<QList<QUrl> >(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, generation, firstFileUrl]() {
+        watcher->deleteLater();
+        if (generation != m_galleryGeneration) {
+            return;
+        }
+
+        m_files = watcher->result();
+        m_currentFileIndex = m_files.indexOf(firstFileUrl);
+        if (m_currentFileIndex < 0 && !m_files.isEmpty()) {
+            // 第一个文件不是有效的图片，或者拖入的只有文件夹
+            showGalleryIndex(0);
+        } else if (m_files.isEmpty() && !firstFileUrl.isValid()) {
+            m_graphicsView->showText(tr("No image file found"));
+        }
+
+        emit galleryLoaded();
+    });
+
+    watcher->setFuture(TaskScheduler::instance()->run(TaskScheduler::Metadata, [urls]() {
+        return expandDroppedUrls(urls);
+    }));
+}
+
 void MainWindow::galleryPrev()
 {
+    // 多页文件中先在页之间切换，到第一页后再切换到上一个文件
+    if (m_pageLoader->showPage(m_pageLoader->currentPage() - 1)) {
+        updatePageIndicator();
+        return;
+    }
+
     int count = m_files.count();
     if (!isGalleryAvailable()) {
         return;
     }
 
-    m_currentFileIndex = m_currentFileIndex - 1 < 0 ? count - 1 : m_currentFileIndex - 1;
-    m_graphicsView->showFileFromUrl(m_files.at(m_currentFileIndex), false);
+    // 手动切换时结束幻灯片
+    if (m_slideshow) {
+        m_slideshow->stop();
+    }
+
+    showGalleryIndex(m_currentFileIndex - 1 < 0 ? count - 1 : m_currentFileIndex - 1);
 }
 
 void MainWindow::galleryNext()
 {
+    if (m_pageLoader->showPage(m_pageLoader->currentPage() + 1)) {
+        updatePageIndicator();
+        return;
+    }
+
     int count = m_files.count();
     if (!isGalleryAvailable()) {
         return;
     }
 
-    m_currentFileIndex = m_currentFileIndex + 1 == count ? 0 : m_currentFileIndex + 1;
+    if (m_slideshow) {
+        m_slideshow->stop();
+    }
 
-    m_graphicsView->showFileFromUrl(m_files.at(m_currentFileIndex), false);
+    showGalleryIndex(m_currentFileIndex + 1 == count ? 0 : m_currentFileIndex + 1);
 }
 
 bool MainWindow::isGalleryAvailable()
@@ -275,6 +724,8 @@ void MainWindow::showEvent(QShowEvent *event)
 
 void MainWindow::enterEvent(QEvent *event)
 {
+    ensureChromeCreated();
+
     m_bottomButtonGroup->setOpacity(1);
     m_gv->setOpacity(1);
 
@@ -287,6 +738,10 @@ void MainWindow::enterEvent(QEvent *event)
 
 void MainWindow::leaveEvent(QEvent *event)
 {
+    if (!m_bottomButtonGroup) {
+        return QMainWindow::leaveEvent(event);
+    }
+
     m_bottomButtonGroup->setOpacity(0);
     m_gv->setOpacity(0);
 
@@ -368,8 +823,9 @@ void MainWindow::resizeEvent(QResizeEvent *event)
 
 void MainWindow::contextMenuEvent(QContextMenuEvent *event)
 {
-    QMenu *menu = new QMenu;
-    QMenu *copyMenu = new QMenu(tr("&Copy"));
+    // 动作和子菜单都挂在 menu 下，随 menu 一起释放
+    QMenu *menu = new QMenu(this);
+    QMenu *copyMenu = new QMenu(tr("&Copy"), menu);
     QUrl currentFileUrl = currentImageFileUrl();
     QImage clipboardImage;
     QUrl clipboardFileUrl;
@@ -390,13 +846,24 @@ void MainWindow::contextMenuEvent(QContextMenuEvent *event)
         }
     }
 
-    QAction *copyPixmap = new QAction(tr("Copy &Pixmap"));
+    QAction *copyPixmap = new QAction(tr("Copy &Pixmap"), menu);
     connect(copyPixmap, &QAction::triggered, this, [=]() {
         QClipboard *cb = QApplication::clipboard();
-        cb->setPixmap(m_graphicsView->scene()->renderToPixmap());
+        // 不在这里渲染或编码，粘贴时才生成数据
+        QString filePath(currentFileUrl.toLocalFile());
+        QPixmap pixmap(m_graphicsView->scene()->currentPixmap());
+        if (pixmap.isNull() && filePath.isEmpty()) {
+            pixmap = m_graphicsView->scene()->renderToPixmap();
+        } else if (!filePath.isEmpty()) {
+            // 不是原图时与直接提供的原文件内容不一致，粘贴时从原文件解码
+            if (!isFullResolution(pixmap, filePath)) {
+                pixmap = QPixmap();
+            }
+        }
+        cb->setMimeData(new ImageMimeData(filePath, pixmap));
     });
 
-    QAction *copyFilePath = new QAction(tr("Copy &File Path"));
+    QAction *copyFilePath = new QAction(tr("Copy &File Path"), menu);
     connect(copyFilePath, &QAction::triggered, this, [=]() {
        QClipboard *cb =  QApplication::clipboard();
        cb->setText(currentFileUrl.toLocalFile());
@@ -407,23 +874,64 @@ void MainWindow::contextMenuEvent(QContextMenuEvent *event)
         copyMenu->addAction(copyFilePath);
     }
 
-    QAction *pasteImage = new QAction(tr("&Paste Image"));
+    QAction *saveAsAction = new QAction(tr("&Save As..."), menu);
+    connect(saveAsAction, &QAction::triggered, this, &MainWindow::saveAs);
+    saveAsAction->setEnabled(!m_imageExporter || !m_imageExporter->isRunning());
+
+    QAction *pasteImage = new QAction(tr("&Paste Image"), menu);
     connect(pasteImage, &QAction::triggered, this, [=](){
         clearGallery();
         m_graphicsView->showImage(clipboardImage);
     });
 
-    QAction *pasteImageFile = new QAction(tr("&Paste Image File"));
+    QAction *pasteImageFile = new QAction(tr("&Paste Image File"), menu);
     connect(pasteImageFile, &QAction::triggered, this, [=](){
        m_graphicsView->showFileFromUrl(clipboardFileUrl, true);
     });
 
-    QAction *protectMode = new QAction(tr("Protected mode"));
+    QAction *compareAction = new QAction(tr("Compare with..."), menu);
+    connect(compareAction, &QAction::triggered, this, [=]() {
+        const QString filePath(currentFileUrl.toLocalFile());
+        const QString otherPath = QFileDialog::getOpenFileName(this, tr("Compare with"), QFileInfo(filePath).absolutePath(),
+                                                               tr("Images (%1)").arg(galleryNameFilters.join(' ')));
+        if (otherPath.isEmpty()) {
+            return;
+        }
+        CompareView *compareView = new CompareView(m_navigationLoader->imageCache(), this);
+        compareView->compare(filePath, otherPath);
+        compareView->show();
+    });
+
+    QMenu *rotateFileMenu = new QMenu(tr("Rotate file"), menu);
+    QAction *rotateFileRight = rotateFileMenu->addAction(tr("Rotate right"));
+    connect(rotateFileRight, &QAction::triggered, this, [=]() {
+        rotateFile(1);
+    });
+    QAction *rotateFileLeft = rotateFileMenu->addAction(tr("Rotate left"));
+    connect(rotateFileLeft, &QAction::triggered, this, [=]() {
+        rotateFile(-1);
+    });
+
+    QAction *slideshow = new QAction(tr("Slideshow"), menu);
+    connect(slideshow, &QAction::triggered, this, [=](){
+        toggleSlideshow();
+    });
+    slideshow->setCheckable(true);
+    slideshow->setChecked(m_slideshow && m_slideshow->isRunning());
+
+    QAction *histogram = new QAction(tr("Histogram"), menu);
+    connect(histogram, &QAction::triggered, this, [=](){
+        toggleHistogram();
+    });
+    histogram->setCheckable(true);
+    histogram->setChecked(m_histogramView && m_histogramView->isVisible());
+
+    QAction *protectMode = new QAction(tr("Protected mode"), menu);
     connect(protectMode, &QAction::triggered, this, [=](){
        toggleProtectMode();
     });
 
-    QAction *stayOnTopMode = new QAction(tr("Stay on top"));
+    QAction *stayOnTopMode = new QAction(tr("Stay on top"), menu);
     connect(stayOnTopMode, &QAction::triggered, this, [=](){
         toggleStayOnTop();
     });
@@ -434,14 +942,14 @@ void MainWindow::contextMenuEvent(QContextMenuEvent *event)
     protectMode->setCheckable(true);
     protectMode->setChecked(m_protectMode);
 
-    QAction *toggleSettings = new QAction(tr("Configure..."));
+    QAction *toggleSettings = new QAction(tr("Configure..."), menu);
     connect(toggleSettings, &QAction::triggered, this, [=]() {
         SettingsDialog *sd = new SettingsDialog(this);
         sd->exec();
         sd->deleteLater();
     });
 
-    QAction * helpAction = new QAction(tr("Help"));
+    QAction * helpAction = new QAction(tr("Help"), menu);
     connect(helpAction, &QAction::triggered, this, [ = ](){
         QStringList sl {
             tr("Launch application with image file path as argument to load the file."),
@@ -460,12 +968,25 @@ void MainWindow::contextMenuEvent(QContextMenuEvent *event)
         menu->addMenu(copyMenu);
     }
 
+    menu->addAction(saveAsAction);
+
     if (!clipboardImage.isNull()) {
         menu->addAction(pasteImage);
     } else if (clipboardFileUrl.isValid()) {
         menu->addAction(pasteImageFile);
     }
 
+    if (currentFileUrl.isLocalFile()) {
+        menu->addAction(compareAction);
+        // 只有 JPEG 可以不重新编码而旋转
+        if (FormatDispatcher::instance()->sniff(currentFileUrl.toLocalFile()).format == "jpeg") {
+            menu->addMenu(rotateFileMenu);
+        }
+    }
+    if (isGalleryAvailable()) {
+        menu->addAction(slideshow);
+    }
+    menu->addAction(histogram);
     menu->addAction(stayOnTopMode);
     menu->addAction(protectMode);
     menu->addSeparator();
@@ -496,13 +1017,56 @@ void MainWindow::centerWindow()
 
 void MainWindow::closeWindow()
 {
-    m_floatUpAnimation->setStartValue(QRect(this->geometry().x(), this->geometry().y(), this->geometry().width(), this->geometry().height()));
-    m_floatUpAnimation->setEndValue(QRect(this->geometry().x(), this->geometry().y()-80, this->geometry().width(), this->geometry().height()));
-    m_exitAnimationGroup->start();
+    // 立即隐藏窗口，不再播放退出动画；之后的清理见 Shutdown
+    close();
+}
+
+void MainWindow::closeEvent(QCloseEvent *event)
+{
+    // 退出时后台任务会被直接取消，正在保存的文件不能这样丢弃：先询问，导出结束之后再关闭
+    if (m_imageExporter && m_imageExporter->isRunning()) {
+        event->ignore();
+        if (m_closeAfterExport) {
+            return;
+        }
+
+        QMessageBox box(QMessageBox::Question, tr("Export in progress"),
+                        tr("An image is still being saved. Wait for it to finish before closing?"),
+                        QMessageBox::NoButton, this);
+        QPushButton *waitButton = box.addButton(tr("Wait"), QMessageBox::AcceptRole);
+        QPushButton *stopButton = box.addButton(tr("Stop export"), QMessageBox::DestructiveRole);
+        box.addButton(QMessageBox::Cancel);
+        box.setDefaultButton(waitButton);
+        box.exec();
+        if (box.clickedButton() != waitButton && box.clickedButton() != stopButton) {
+            return;
+        }
+        // 在对话框打开期间导出可能已经结束
+        if (!m_imageExporter->isRunning()) {
+            close();
+            return;
+        }
+
+        m_closeAfterExport = true;
+        connect(m_imageExporter, &ImageExporter::finished, this, [this]() {
+            close();
+        });
+        if (box.clickedButton() == stopButton) {
+            // 取消后临时文件被丢弃，不会留下不完整的文件
+            m_imageExporter->cancel();
+        }
+        return;
+    }
+
+    QMainWindow::closeEvent(event);
 }
 
 void MainWindow::updateWidgetsPosition()
 {
+    if (!m_bottomButtonGroup) {
+        return;
+    }
+
     m_closeButton->move(width() - m_closeButton->width(), 0);
     m_prevButton->move(25, (height() - m_prevButton->height()) / 2);
     m_nextButton->move(width() - m_nextButton->width() - 25,
@@ -515,6 +1079,10 @@ void MainWindow::updateWidgetsPosition()
 void MainWindow::toggleProtectMode()
 {
     m_protectMode = !m_protectMode;
+    if (!m_closeButton) {
+        return;
+    }
+
     m_closeButton->setVisible(!m_protectMode);
     m_prevButton->setVisible(!m_protectMode);
     m_nextButton->setVisible(!m_protectMode);
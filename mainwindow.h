@@ -2,8 +2,6 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
-#include <QParallelAnimationGroup>
-#include <QPropertyAnimation>
 #include <QPushButton>
 #include <QShowEvent>
 
@@ -16,6 +14,11 @@ class ToolButton;
 class GraphicsView;
 class NavigatorView;
 class BottomButtonGroup;
+class Slideshow;
+class NavigationLoader;
+class ImageExporter;
+class HistogramView;
+class PageLoader;
 
 class MainWindow : public QMainWindow
 {
@@ -31,6 +34,7 @@ public:
 
     void clearGallery();
     void loadGalleryBySingleLocalFile(const QString &path);
+    void loadGalleryByUrls(const QList<QUrl> &urls);
     void galleryPrev();
     void galleryNext();
     bool isGalleryAvailable();
@@ -49,6 +53,7 @@ protected slots:
     void wheelEvent(QWheelEvent *event)            override;
     void resizeEvent(QResizeEvent *event)          override;
     void contextMenuEvent(QContextMenuEvent *event)override;
+    void closeEvent(QCloseEvent *event)            override;
 
     QSize sizeHint()                         const override;
 
@@ -62,23 +67,45 @@ protected slots:
     void quitAppAction(bool force = false);
     void toggleFullscreen(); // 全屏/正常
     void toggleMaximize();
+    void toggleSlideshow();
+    void toggleHistogram();
+    void updateHistogram();
+    void saveAs();
+    void rotateFile(int quarterTurns);
 
 private:
+    void ensureChromeCreated();
+    void updateNavigatorView();
+    void showGalleryIndex(int index);
+    void openPages(const QUrl &url);
+    // pixmap 是否是 filePath 完整解码的原图
+    bool isFullResolution(const QPixmap &pixmap, const QString &filePath) const;
+    void updatePageIndicator();
+
     QPoint                   m_oldMousePos;
-    QPropertyAnimation      *m_fadeOutAnimation;
-    QPropertyAnimation      *m_floatUpAnimation;
-    QParallelAnimationGroup *m_exitAnimationGroup;
-    ToolButton              *m_closeButton;
-    ToolButton              *m_prevButton;
-    ToolButton              *m_nextButton;
+    ToolButton              *m_closeButton = nullptr;
+    ToolButton              *m_prevButton = nullptr;
+    ToolButton              *m_nextButton = nullptr;
     GraphicsView            *m_graphicsView;
-    NavigatorView           *m_gv;
+    NavigatorView           *m_gv = nullptr;
 
-    BottomButtonGroup       *m_bottomButtonGroup;
+    BottomButtonGroup       *m_bottomButtonGroup = nullptr;
+    Slideshow               *m_slideshow = nullptr;
+    NavigationLoader        *m_navigationLoader;
+    PageLoader              *m_pageLoader;
+    ImageExporter           *m_imageExporter = nullptr;
+    HistogramView           *m_histogramView = nullptr;
+    bool                     m_navigatorRequired = false;
+    qreal                    m_navigatorAngle = 0;
+    qreal                    m_navigatorFittedAngle = 0;
+    QRectF                   m_navigatorFittedRect;
     bool                     m_protectMode = false;
     bool                     m_clickedOnWindow = false;
+    bool                     m_closeAfterExport = false;
 
     QList<QUrl>              m_files;
     int                      m_currentFileIndex = -1;
+    qint64                   m_previewPixmapKey = 0; // 解码完成之前显示的缩略图
+    int                      m_galleryGeneration = 0;
 };
 #endif // MAINWINDOW_H
@@ -0,0 +1,211 @@
+#include "navigationloader.h"
+
+#include "formatdispatcher.h"
+#include "embeddedpreview.h"
+#include "imageloader.h"
+#include "pipelinestats.h"
+#include "taskscheduler.h"
+
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QPointer>
+
+namespace {
+
+// 小于这个大小的 JPEG 直接解码已经足够快
+const qint64 LargeJpegBytes = 4 * 1024 * 1024;
+
+bool hasUsefulEmbeddedPreview(const QString &filePath)
+{
+    const QFileInfo info(filePath);
+    if (EmbeddedPreview::isRawSuffix(info.suffix())) {
+        return true;
+    }
+    return info.size() > LargeJpegBytes && FormatDispatcher::instance()->sniff(filePath).format == "jpeg";
+}
+
+} // namespace
+
+NavigationLoader::NavigationLoader(QObject *parent)
+    : QObject(parent)
+    , m_thumbnails(32 * 1024)
+    , m_imageCache(new ImageCache(this))
+{
+}
+
+void NavigationLoader::load(const QUrl &url)
+{
+    const QString filePath(url.toLocalFile());
+
+    if (FormatDispatcher::instance()->sniff(filePath).engine != EngineStill) {
+        cancel();
+        emit directLoadRequired(url);
+        return;
+    }
+
+    QImage image;
+    QSize fullSize;
+    ImageCache::ColdEntry cold;
+    const bool hot = m_imageCache->lookup(filePath, &image, &fullSize);
+    PipelineStats::instance()->recordCacheLookup(PipelineStats::DecodedCache,
+                                                 hot || m_imageCache->coldEntry(filePath, &cold));
+    if (hot) {
+        cancel();
+        emit imageReady(url, image, fullSize);
+        return;
+    }
+
+    Thumbnail *thumbnail = m_thumbnails.object(filePath);
+    PipelineStats::instance()->recordCacheLookup(PipelineStats::ThumbnailCache, thumbnail != nullptr);
+    if (thumbnail) {
+        emit previewReady(url, thumbnail->image, thumbnail->originalSize);
+    }
+
+    if (m_inflightUrl.isValid()) {
+        // 已经有图片在解码，只记住最后一次请求
+        if (m_inflightUrl != url) {
+            m_inflightCancelled->storeRelease(1);
+        }
+        m_pendingUrl = url;
+        return;
+    }
+
+    startDecode(url);
+}
+
+void NavigationLoader::cancel()
+{
+    m_pendingUrl.clear();
+    if (m_inflightUrl.isValid()) {
+        m_inflightCancelled->storeRelease(1);
+    }
+}
+
+void NavigationLoader::setGalleryPosition(const QList<QUrl> &files, int index)
+{
+    QStringList filePaths;
+    for (const QUrl &url : files) {
+        filePaths.append(url.toLocalFile());
+    }
+    m_imageCache->setPosition(filePaths, index);
+}
+
+ImageCache *NavigationLoader::imageCache() const
+{
+    return m_imageCache;
+}
+
+void NavigationLoader::invalidate(const QString &filePath)
+{
+    m_thumbnails.remove(filePath);
+    m_imageCache->invalidate(filePath);
+    m_generation++;
+
+    // 正在解码的是文件修改之前的内容：取消后由 onDecodeFinished() 重新解码，旧的结果不会显示或缓存
+    if (m_inflightUrl.isValid() && m_inflightUrl.toLocalFile() == filePath) {
+        m_inflightCancelled->storeRelease(1);
+        if (!m_pendingUrl.isValid()) {
+            m_pendingUrl = m_inflightUrl;
+        }
+    }
+}
+
+void NavigationLoader::startDecode(const QUrl &url)
+{
+    const QString filePath(url.toLocalFile());
+    QSharedPointer<QAtomicInt> cancelled(new QAtomicInt(0));
+
+    m_inflightUrl = url;
+    m_inflightCancelled = cancelled;
+
+    QFutureWatcher<Result> *watcher = new QFutureWatcher<Result>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, url, cancelled]() {
+        watcher->deleteLater();
+        onDecodeFinished(url, watcher->result(), cancelled->loadAcquire());
+    });
+
+    // 冷层中的图片不用读盘，恢复得比原图解码快
+    ImageCache::ColdEntry cold;
+    const bool hasCold = m_imageCache->coldEntry(filePath, &cold);
+
+    // 没有缓存的缩略图时，先用 RAW/大 JPEG 中内嵌的小预览图立即显示
+    const bool wantPreview = !hasCold && !m_thumbnails.contains(filePath);
+    const int generation = m_generation;
+    QPointer<NavigationLoader> self(this);
+
+    watcher->setFuture(TaskScheduler::instance()->run(TaskScheduler::VisibleImage,
+                                                      [filePath, url, cancelled, cold, wantPreview, generation, self]() {
+        if (wantPreview && hasUsefulEmbeddedPreview(filePath)) {
+            const EmbeddedPreview::Preview preview = EmbeddedPreview::read(filePath, EmbeddedPreview::SmallestPreview);
+            const QImage image = EmbeddedPreview::decode(preview, QSize(ThumbnailSize, ThumbnailSize));
+            if (self && !image.isNull() && preview.fullSize.isValid()) {
+                const QSize fullSize = preview.fullSize;
+                QMetaObject::invokeMethod(self.data(), [self, url, image, fullSize, cancelled, generation]() {
+                    if (!self || self->m_generation != generation) {
+                        return;
+                    }
+                    // 快速跳过时原图的解码会被取消，预览图仍然作为缩略图保留，再次经过时不必重新解析
+                    self->insertThumbnail(url.toLocalFile(), image, fullSize);
+                    if (!cancelled->loadAcquire()) {
+                        emit self->previewReady(url, image, fullSize);
+                    }
+                }, Qt::QueuedConnection);
+            }
+        }
+
+        Result result;
+        if (cold.isValid()) {
+            result.image = ImageCache::restore(cold, cancelled.data());
+            result.fullSize = cold.fullSize;
+        }
+        if (result.image.isNull()) {
+            const QSize fullSize = ImageLoader::imageSize(filePath);
+            if (qint64(fullSize.width()) * fullSize.height() > OverviewMinPixels
+                    && ImageLoader::supportsRegionDecoding(filePath)) {
+                result.image = ImageLoader::decode(filePath, QSize(OverviewSize, OverviewSize), cancelled.data());
+                result.fullSize = fullSize;
+            } else {
+                result.image = ImageLoader::decode(filePath, QSize(), cancelled.data());
+                result.fullSize = result.image.size();
+            }
+        }
+        if (!result.image.isNull()) {
+            result.thumbnail = result.image.scaled(ThumbnailSize, ThumbnailSize,
+                                                   Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        }
+        return result;
+    }, cancelled));
+}
+
+void NavigationLoader::insertThumbnail(const QString &filePath, const QImage &image, const QSize &originalSize)
+{
+    Thumbnail *thumbnail = new Thumbnail;
+    thumbnail->image = image;
+    thumbnail->originalSize = originalSize;
+    thumbnail->memory.setBytes(ImageMemory::bytesOf(image));
+    m_thumbnails.insert(filePath, thumbnail, qMax(1, static_cast<int>(image.sizeInBytes() / 1024)));
+}
+
+void NavigationLoader::onDecodeFinished(const QUrl &url, const Result &result, bool cancelled)
+{
+    m_inflightUrl.clear();
+    m_inflightCancelled.clear();
+
+    if (!cancelled && !result.thumbnail.isNull()) {
+        insertThumbnail(url.toLocalFile(), result.thumbnail, result.fullSize);
+    }
+
+    const QUrl pendingUrl(m_pendingUrl);
+    m_pendingUrl.clear();
+
+    if (!pendingUrl.isValid() || (pendingUrl == url && !cancelled)) {
+        if (!cancelled) {
+            m_imageCache->insert(url.toLocalFile(), result.image, result.fullSize);
+            emit imageReady(url, result.image, result.fullSize);
+        }
+        return;
+    }
+
+    // 解码期间又有新的请求，继续加载最新的那一张
+    startDecode(pendingUrl);
+}
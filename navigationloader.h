@@ -0,0 +1,73 @@
+#ifndef NAVIGATIONLOADER_H
+#define NAVIGATIONLOADER_H
+
+#include "imagecache.h"
+#include "imagememory.h"
+
+#include <QAtomicInt>
+#include <QCache>
+#include <QImage>
+#include <QObject>
+#include <QSharedPointer>
+#include <QUrl>
+
+/**
+ * @brief 图库切换时的异步加载
+ *
+ * 同一时间只解码一张图片。连续切换时只有最后请求的图片会以原始质量加载，
+ * 被跳过的图片的解码会被取消，中间的图片仅显示已缓存的缩略图。
+ * 解码结果放入 ImageCache，回到最近看过的图片时不必重新读取和解码。
+ */
+class NavigationLoader : public QObject
+{
+    Q_OBJECT
+public:
+    explicit NavigationLoader(QObject *parent = nullptr);
+
+    static const int ThumbnailSize = 384;
+    // 超过这个像素数并且解码器支持区域解码的图片只解码概览图，放大时再解码可见区域
+    static const qint64 OverviewMinPixels = 100 * 1000 * 1000;
+    static const int OverviewSize = 4096;
+
+    void load(const QUrl &url);
+    void cancel();
+
+    // 图库位置变化时调用，决定解码后的图片哪些留在内存中
+    void setGalleryPosition(const QList<QUrl> &files, int index);
+    ImageCache *imageCache() const;
+    // 文件内容被修改后调用，只丢弃这个文件的缩略图和解码结果，正在进行的解码会重新开始
+    void invalidate(const QString &filePath);
+
+signals:
+    void previewReady(const QUrl &url, const QImage &thumbnail, const QSize &originalSize);
+    // image 小于 fullSize 时是很大的图片的概览图
+    void imageReady(const QUrl &url, const QImage &image, const QSize &fullSize);
+    // 动图和矢量图不经过解码线程，直接交给 GraphicsView 显示
+    void directLoadRequired(const QUrl &url);
+
+private:
+    struct Thumbnail {
+        QImage image;
+        QSize  originalSize;
+        ImageMemoryTicket memory { ImageMemory::Cache };
+    };
+
+    struct Result {
+        QImage image;
+        QImage thumbnail;
+        QSize  fullSize;
+    };
+
+    void startDecode(const QUrl &url);
+    void onDecodeFinished(const QUrl &url, const Result &result, bool cancelled);
+    void insertThumbnail(const QString &filePath, const QImage &image, const QSize &originalSize);
+
+    QUrl m_inflightUrl;
+    QSharedPointer<QAtomicInt> m_inflightCancelled;
+    QUrl m_pendingUrl;
+    int m_generation = 0; // 每次 invalidate() 加一，丢弃之前读取的内嵌预览图
+    QCache<QString, Thumbnail> m_thumbnails; // cost 以 KB 计
+    ImageCache *m_imageCache;
+};
+
+#endif // NAVIGATIONLOADER_H
@@ -1,5 +1,6 @@
 #include "navigatorview.h"
 
+#include "glviewport.h"
 #include "graphicsview.h"
 #include "opacityhelper.h"
 
@@ -28,10 +29,16 @@ void NavigatorView::setOpacity(qreal opacity, bool animated)
     m_opacityHelper->setOpacity(opacity, animated);
 }
 
+void NavigatorView::setOpenGLEnabled(bool enabled)
+{
+    GLViewport::install(this, enabled);
+}
+
 void NavigatorView::updateMainViewportRegion()
 {
     if (m_mainView != nullptr) {
         m_viewportRegion = mapFromScene(m_mainView->mapToScene(m_mainView->rect()));
+        viewport()->update();
     }
 }
 
@@ -14,6 +14,7 @@ public:
 
     void setMainView(GraphicsView *mainView);
     void setOpacity(qreal opacity, bool animated = true);
+    void setOpenGLEnabled(bool enabled);
 
 public slots:
     void updateMainViewportRegion(); // 更新右下角预览框位置
@@ -0,0 +1,171 @@
+#include "pageloader.h"
+
+#include "imageloader.h"
+
+#include <QFutureWatcher>
+
+PageLoader::PageLoader(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void PageLoader::open(const QUrl &url)
+{
+    close();
+    m_url = url;
+
+    const int generation = m_generation;
+    const QString filePath(url.toLocalFile());
+    QFutureWatcher<int> *watcher = new QFutureWatcher<int>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, generation]() {
+        watcher->deleteLater();
+        if (generation != m_generation) {
+            return;
+        }
+
+        m_pageCount = watcher->result();
+        emit pagesCounted(m_url, m_pageCount);
+
+        // 第一页已经由常规流程显示，这里只预先解码第二页
+        if (m_pageCount > 1) {
+            decodePage(1, TaskScheduler::Neighbor);
+        }
+    });
+
+    watcher->setFuture(TaskScheduler::instance()->run(TaskScheduler::Metadata, [filePath]() {
+        return ImageLoader::imageCount(filePath);
+    }));
+}
+
+void PageLoader::close()
+{
+    // 还在解码的页在完成后被丢弃
+    m_generation++;
+    for (const TaskScheduler::CancellationToken &token : qAsConst(m_pending)) {
+        token->storeRelease(1);
+    }
+
+    m_url.clear();
+    m_pageCount = 0;
+    m_currentPage = 0;
+    m_pages.clear();
+    m_pending.clear();
+    updateMemoryUsage();
+}
+
+QUrl PageLoader::url() const
+{
+    return m_url;
+}
+
+int PageLoader::pageCount() const
+{
+    return m_pageCount;
+}
+
+int PageLoader::currentPage() const
+{
+    return m_currentPage;
+}
+
+bool PageLoader::showPage(int page)
+{
+    if (m_pageCount <= 1 || page < 0 || page >= m_pageCount) {
+        return false;
+    }
+
+    m_currentPage = page;
+
+    // 已经离开窗口的页不再解码
+    for (QHash<int, TaskScheduler::CancellationToken>::iterator it = m_pending.begin(); it != m_pending.end();) {
+        if (isInWindow(it.key())) {
+            ++it;
+        } else {
+            it.value()->storeRelease(1);
+            it = m_pending.erase(it);
+        }
+    }
+
+    for (QHash<int, QImage>::iterator it = m_pages.begin(); it != m_pages.end();) {
+        if (isInWindow(it.key())) {
+            ++it;
+        } else {
+            it = m_pages.erase(it);
+        }
+    }
+    updateMemoryUsage();
+
+    if (m_pages.contains(page)) {
+        emit pageReady(m_url, page, m_pages.value(page));
+    } else if (m_pending.contains(page)) {
+        // 之前作为相邻页预先解码，现在要显示它
+        TaskScheduler::instance()->setPriority(m_pending.value(page), TaskScheduler::VisibleImage);
+    } else {
+        decodePage(page, TaskScheduler::VisibleImage);
+    }
+
+    if (page > 0) {
+        decodePage(page - 1, TaskScheduler::Neighbor);
+    }
+    if (page + 1 < m_pageCount) {
+        decodePage(page + 1, TaskScheduler::Neighbor);
+    }
+
+    return true;
+}
+
+void PageLoader::decodePage(int page, TaskScheduler::Priority priority)
+{
+    if (m_pages.contains(page) || m_pending.contains(page)) {
+        return;
+    }
+    const TaskScheduler::CancellationToken cancelled(new QAtomicInt(0));
+    m_pending.insert(page, cancelled);
+
+    const int generation = m_generation;
+    const QString filePath(m_url.toLocalFile());
+    QFutureWatcher<QImage> *watcher = new QFutureWatcher<QImage>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, generation, page, cancelled]() {
+        watcher->deleteLater();
+        onPageDecoded(generation, page, cancelled, watcher->result());
+    });
+
+    watcher->setFuture(TaskScheduler::instance()->run(priority, [filePath, page, cancelled]() {
+        return ImageLoader::decode(filePath, QSize(), cancelled.data(), page);
+    }, cancelled));
+}
+
+void PageLoader::onPageDecoded(int generation, int page, const TaskScheduler::CancellationToken &token,
+                               const QImage &image)
+{
+    // 取消的解码可能只返回了一部分
+    if (generation != m_generation || token->loadAcquire()) {
+        return;
+    }
+
+    m_pending.remove(page);
+    if (!isInWindow(page)) {
+        return;
+    }
+
+    m_pages.insert(page, image);
+    updateMemoryUsage();
+
+    if (page == m_currentPage) {
+        emit pageReady(m_url, page, image);
+    }
+}
+
+bool PageLoader::isInWindow(int page) const
+{
+    return qAbs(page - m_currentPage) <= 1;
+}
+
+void PageLoader::updateMemoryUsage()
+{
+    qint64 bytes = 0;
+    for (const QImage &image : m_pages) {
+        bytes += ImageMemory::bytesOf(image);
+    }
+    m_memory.setBytes(bytes);
+}
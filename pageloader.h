@@ -0,0 +1,55 @@
+#ifndef PAGELOADER_H
+#define PAGELOADER_H
+
+#include "imagememory.h"
+#include "taskscheduler.h"
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QImage>
+#include <QObject>
+#include <QSharedPointer>
+#include <QUrl>
+
+/**
+ * @brief 多页文件(多页 TIFF、多尺寸 ICO 等)的分页加载
+ *
+ * 页数只从文件头读取，不解码任何一页。只解码当前页和相邻的页，其余的页不占用内存。
+ */
+class PageLoader : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PageLoader(QObject *parent = nullptr);
+
+    // 在后台读取页数，完成后发出 pagesCounted
+    void open(const QUrl &url);
+    void close();
+
+    QUrl url() const;
+    int pageCount() const;
+    int currentPage() const;
+
+    // page 超出范围或不是多页文件时返回 false
+    bool showPage(int page);
+
+signals:
+    void pagesCounted(const QUrl &url, int count);
+    void pageReady(const QUrl &url, int page, const QImage &image);
+
+private:
+    void decodePage(int page, TaskScheduler::Priority priority);
+    void onPageDecoded(int generation, int page, const TaskScheduler::CancellationToken &token, const QImage &image);
+    bool isInWindow(int page) const;
+    void updateMemoryUsage();
+
+    QUrl m_url;
+    int m_pageCount = 0;
+    int m_currentPage = 0;
+    int m_generation = 0;
+    QHash<int, QImage> m_pages;
+    QHash<int, TaskScheduler::CancellationToken> m_pending; // 正在解码的页
+    ImageMemoryTicket m_memory { ImageMemory::Cache };
+};
+
+#endif // PAGELOADER_H
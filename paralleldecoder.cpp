@@ -0,0 +1,680 @@
+#include "paralleldecoder.h"
+
+#include <QBuffer>
+#include <QFuture>
+#include <QIODevice>
+#include <QImageReader>
+#include <QThread>
+#include <QVector>
+#include <QtConcurrent>
+#include <QtEndian>
+
+#include <zlib.h>
+
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// 更小的图片单线程解码已经足够快，拆分反而得不偿失
+const qint64 MinPixels = 16 * 1000 * 1000;
+
+bool isCancelled(const QAtomicInt *cancelled)
+{
+    return cancelled && cancelled->loadAcquire();
+}
+
+qint64 lcm(qint64 a, qint64 b)
+{
+    qint64 x = a;
+    qint64 y = b;
+    while (y != 0) {
+        const qint64 t = x % y;
+        x = y;
+        y = t;
+    }
+    return a / x * b;
+}
+
+// ---------------------------------------------------------------------------
+// JPEG
+
+struct JpegLayout
+{
+    QByteArray header;          // 每个条带都需要的段：APP0、APP14、DQT、DHT、DRI、SOF、SOS
+    int heightOffset = -1;      // header 中 SOF 高度字段的位置
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    int mcuWidth = 8;
+    int mcuHeight = 8;
+    int restartInterval = 0;
+};
+
+struct JpegBand
+{
+    int firstSegment;
+    int lastSegment;            // 不含
+    int top;
+    int bottom;                 // 不含
+};
+
+// 读取 SOS 之前的所有段，只接受 8 位基线/扩展顺序编码、单次扫描且所有分量交织的 JPEG
+bool readJpegHeader(QIODevice *device, JpegLayout *layout)
+{
+    char soi[2];
+    if (device->read(soi, 2) != 2 || uchar(soi[0]) != 0xFF || uchar(soi[1]) != 0xD8) {
+        return false;
+    }
+
+    bool seenFrame = false;
+    for (;;) {
+        char c;
+        if (!device->getChar(&c) || uchar(c) != 0xFF) {
+            return false;
+        }
+        do {
+            if (!device->getChar(&c)) {
+                return false;
+            }
+        } while (uchar(c) == 0xFF);
+
+        const uchar marker = uchar(c);
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+            continue;
+        }
+
+        uchar lengthBytes[2];
+        if (device->read(reinterpret_cast<char *>(lengthBytes), 2) != 2) {
+            return false;
+        }
+        const int length = qFromBigEndian<quint16>(lengthBytes);
+        if (length < 2) {
+            return false;
+        }
+        const QByteArray payload = device->read(length - 2);
+        if (payload.size() != length - 2) {
+            return false;
+        }
+        const uchar *p = reinterpret_cast<const uchar *>(payload.constData());
+
+        if (marker == 0xC0 || marker == 0xC1) {
+            if (payload.size() < 6 || p[0] != 8) {
+                return false;
+            }
+            layout->height = qFromBigEndian<quint16>(p + 1);
+            layout->width = qFromBigEndian<quint16>(p + 3);
+            layout->components = p[5];
+            if (layout->width == 0 || layout->height == 0 || payload.size() < 6 + layout->components * 3) {
+                return false;
+            }
+            if (layout->components != 1 && layout->components != 3) {
+                return false;
+            }
+            // 单分量扫描的 MCU 总是一个 8x8 块
+            if (layout->components == 3) {
+                int maxH = 1;
+                int maxV = 1;
+                for (int i = 0; i < layout->components; i++) {
+                    maxH = qMax(maxH, p[6 + i * 3 + 1] >> 4);
+                    maxV = qMax(maxV, p[6 + i * 3 + 1] & 0x0F);
+                }
+                layout->mcuWidth = 8 * maxH;
+                layout->mcuHeight = 8 * maxV;
+            }
+            layout->heightOffset = layout->header.size() + 5;
+            seenFrame = true;
+        } else if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            // 渐进、无损、算术编码等
+            return false;
+        } else if (marker == 0xDC) {
+            // DNL：高度写在扫描数据之后
+            return false;
+        } else if (marker == 0xDD) {
+            if (payload.size() < 2) {
+                return false;
+            }
+            layout->restartInterval = qFromBigEndian<quint16>(p);
+        } else if (marker == 0xDA) {
+            if (!seenFrame || payload.isEmpty() || p[0] != layout->components) {
+                return false;
+            }
+        } else if ((marker >= 0xE1 && marker <= 0xED) || marker == 0xEF || marker == 0xFE) {
+            // EXIF、XMP 等元数据不影响解码，也不必复制到每个条带中
+            continue;
+        }
+
+        layout->header.append(char(0xFF));
+        layout->header.append(char(marker));
+        layout->header.append(reinterpret_cast<const char *>(lengthBytes), 2);
+        layout->header.append(payload);
+
+        if (marker == 0xDA) {
+            return true;
+        }
+    }
+}
+
+// 找到熵编码数据中的每个 RST 标记，返回各重启段的结束位置
+QVector<int> findRestartSegments(const QByteArray &data)
+{
+    QVector<int> ends;
+    const uchar *d = reinterpret_cast<const uchar *>(data.constData());
+    const int size = data.size();
+    int end = size;
+    int i = 0;
+    while (i + 1 < size) {
+        const uchar *ff = static_cast<const uchar *>(memchr(d + i, 0xFF, static_cast<size_t>(size - i - 1)));
+        if (!ff) {
+            break;
+        }
+        i = static_cast<int>(ff - d);
+        const uchar next = d[i + 1];
+        if (next == 0x00) {
+            i += 2;
+        } else if (next >= 0xD0 && next <= 0xD7) {
+            ends.append(i);
+            i += 2;
+        } else if (next == 0xFF) {
+            i++;
+        } else {
+            // EOI 或其他标记
+            end = i;
+            break;
+        }
+    }
+    ends.append(end);
+    return ends;
+}
+
+QByteArray buildBandJpeg(const JpegLayout &layout, const QByteArray &data, const QVector<int> &ends,
+                         const JpegBand &band)
+{
+    const int firstBegin = band.firstSegment == 0 ? 0 : ends.at(band.firstSegment - 1) + 2;
+    const int lastEnd = ends.at(band.lastSegment - 1);
+
+    QByteArray jpeg;
+    jpeg.reserve(layout.header.size() + (lastEnd - firstBegin) + 4);
+    jpeg.append("\xFF\xD8", 2);
+    jpeg.append(layout.header);
+
+    const int height = band.bottom - band.top;
+    jpeg[2 + layout.heightOffset] = char((height >> 8) & 0xFF);
+    jpeg[2 + layout.heightOffset + 1] = char(height & 0xFF);
+
+    // 解码器要求 RST 标记从 RST0 开始依次循环，需要重新编号
+    for (int segment = band.firstSegment; segment < band.lastSegment; segment++) {
+        const int begin = segment == 0 ? 0 : ends.at(segment - 1) + 2;
+        jpeg.append(data.constData() + begin, ends.at(segment) - begin);
+        if (segment + 1 < band.lastSegment) {
+            jpeg.append(char(0xFF));
+            jpeg.append(char(0xD0 + (segment - band.firstSegment) % 8));
+        }
+    }
+    jpeg.append("\xFF\xD9", 2);
+    return jpeg;
+}
+
+QImage decodeJpeg(QIODevice *device, const QAtomicInt *cancelled)
+{
+    JpegLayout layout;
+    if (!readJpegHeader(device, &layout) || layout.restartInterval <= 0
+            || qint64(layout.width) * layout.height < MinPixels) {
+        return QImage();
+    }
+
+    const qint64 mcusPerRow = (layout.width + layout.mcuWidth - 1) / layout.mcuWidth;
+    const qint64 mcuRows = (layout.height + layout.mcuHeight - 1) / layout.mcuHeight;
+    const qint64 segmentCount = (mcusPerRow * mcuRows + layout.restartInterval - 1) / layout.restartInterval;
+
+    // 重启段的边界和 MCU 行的开头每隔 lcm(重启间隔, 每行 MCU 数) 个 MCU 重合一次，只能在这些位置切分
+    const qint64 periodMcus = lcm(layout.restartInterval, mcusPerRow);
+    const qint64 periodSegments = periodMcus / layout.restartInterval;
+    const qint64 periodRows = periodMcus / mcusPerRow;
+    const qint64 periodCount = (segmentCount + periodSegments - 1) / periodSegments;
+    if (periodCount < 2) {
+        return QImage();
+    }
+
+    const QByteArray data = device->readAll();
+    if (isCancelled(cancelled)) {
+        return QImage();
+    }
+    const QVector<int> ends = findRestartSegments(data);
+    if (ends.count() != segmentCount) {
+        return QImage();
+    }
+
+    const int bandCount = static_cast<int>(qMin<qint64>(periodCount, qMax(1, QThread::idealThreadCount() * 2)));
+    QVector<JpegBand> bands;
+    for (int i = 0; i < bandCount; i++) {
+        const qint64 firstPeriod = periodCount * i / bandCount;
+        const qint64 lastPeriod = periodCount * (i + 1) / bandCount;
+        JpegBand band;
+        band.firstSegment = static_cast<int>(firstPeriod * periodSegments);
+        band.lastSegment = static_cast<int>(qMin(segmentCount, lastPeriod * periodSegments));
+        band.top = static_cast<int>(firstPeriod * periodRows * layout.mcuHeight);
+        band.bottom = static_cast<int>(qMin<qint64>(layout.height, lastPeriod * periodRows * layout.mcuHeight));
+        bands.append(band);
+    }
+
+    const QImage::Format format = layout.components == 1 ? QImage::Format_Grayscale8 : QImage::Format_RGB32;
+    QImage image(layout.width, layout.height, format);
+    if (image.isNull()) {
+        return QImage();
+    }
+    uchar *bits = image.bits();
+    const int bytesPerLine = image.bytesPerLine();
+
+    QAtomicInt failed(0);
+    QtConcurrent::blockingMap(bands, [&](const JpegBand &band) {
+        if (failed.loadAcquire() || isCancelled(cancelled)) {
+            failed.storeRelease(1);
+            return;
+        }
+
+        QByteArray jpeg = buildBandJpeg(layout, data, ends, band);
+        QBuffer buffer(&jpeg);
+        buffer.open(QIODevice::ReadOnly);
+        QImageReader reader(&buffer, "jpeg");
+
+        // 尺寸和格式一致时解码器直接写入这块内存，不会另外分配
+        uchar *first = bits + qint64(band.top) * bytesPerLine;
+        QImage target(first, layout.width, band.bottom - band.top, bytesPerLine, format);
+        if (!reader.read(&target) || target.constBits() != first) {
+            failed.storeRelease(1);
+        }
+    });
+
+    if (failed.loadAcquire()) {
+        return QImage();
+    }
+    return image;
+}
+
+// ---------------------------------------------------------------------------
+// PNG
+
+enum PngColorType {
+    PngGray      = 0,
+    PngRgb       = 2,
+    PngPalette   = 3,
+    PngGrayAlpha = 4,
+    PngRgba      = 6
+};
+
+// 解压后的数据每块约 1 MB，两块交替使用
+const int PngBlockBytes = 1024 * 1024;
+const int PngInputBytes = 64 * 1024;
+const quint32 MaxAncillaryChunkSize = 16 * 1024 * 1024;
+
+struct PngLayout
+{
+    int width = 0;
+    int height = 0;
+    int colorType = -1;
+    int channels = 0;           // 只支持 8 位深度，等于每个像素的字节数
+    QVector<QRgb> palette;
+};
+
+// 读取第一个 IDAT 之前的所有块，只接受 8 位深度、非隔行扫描、没有色彩配置的 PNG
+bool readPngHeader(QIODevice *device, PngLayout *layout, quint32 *idatLength)
+{
+    char signature[8];
+    if (device->read(signature, 8) != 8 || memcmp(signature, "\x89PNG\r\n\x1a\n", 8) != 0) {
+        return false;
+    }
+
+    for (;;) {
+        uchar chunk[8];
+        if (device->read(reinterpret_cast<char *>(chunk), 8) != 8) {
+            return false;
+        }
+        const quint32 length = qFromBigEndian<quint32>(chunk);
+        const QByteArray type(reinterpret_cast<const char *>(chunk + 4), 4);
+
+        if (type == "IDAT") {
+            if (layout->channels == 0 || (layout->colorType == PngPalette && layout->palette.isEmpty())) {
+                return false;
+            }
+            *idatLength = length;
+            return true;
+        }
+
+        // 带有色彩配置或 gamma 的图片交给 Qt 的解码器，保证得到的颜色一致
+        if (type == "iCCP" || type == "gAMA" || length > MaxAncillaryChunkSize) {
+            return false;
+        }
+
+        const QByteArray data = device->read(length);
+        char crc[4];
+        if (data.size() != static_cast<int>(length) || device->read(crc, 4) != 4) {
+            return false;
+        }
+        const uchar *p = reinterpret_cast<const uchar *>(data.constData());
+
+        if (type == "IHDR") {
+            if (data.size() < 13) {
+                return false;
+            }
+            const quint32 width = qFromBigEndian<quint32>(p);
+            const quint32 height = qFromBigEndian<quint32>(p + 4);
+            // 位深、压缩方法、滤波方法、隔行扫描
+            if (width == 0 || height == 0 || width > 0x7FFFFF || height > 0x7FFFFF
+                    || p[8] != 8 || p[10] != 0 || p[11] != 0 || p[12] != 0) {
+                return false;
+            }
+            layout->width = static_cast<int>(width);
+            layout->height = static_cast<int>(height);
+            layout->colorType = p[9];
+            switch (layout->colorType) {
+            case PngGray:
+            case PngPalette:
+                layout->channels = 1;
+                break;
+            case PngGrayAlpha:
+                layout->channels = 2;
+                break;
+            case PngRgb:
+                layout->channels = 3;
+                break;
+            case PngRgba:
+                layout->channels = 4;
+                break;
+            default:
+                return false;
+            }
+        } else if (type == "PLTE") {
+            layout->palette.clear();
+            for (int i = 0; i + 2 < data.size() && layout->palette.count() < 256; i += 3) {
+                layout->palette.append(qRgb(p[i], p[i + 1], p[i + 2]));
+            }
+        } else if (type == "tRNS") {
+            // 灰度和 RGB 图片的透明色需要转换成 alpha 通道，交给 Qt 的解码器
+            if (layout->colorType != PngPalette) {
+                return false;
+            }
+            for (int i = 0; i < data.size() && i < layout->palette.count(); i++) {
+                const QRgb color = layout->palette.at(i);
+                layout->palette[i] = qRgba(qRed(color), qGreen(color), qBlue(color), p[i]);
+            }
+        }
+    }
+}
+
+// 依次读取各个 IDAT 块中的压缩数据
+class IdatStream
+{
+public:
+    IdatStream(QIODevice *device, quint32 firstLength)
+        : m_device(device)
+        , m_remaining(firstLength)
+    {
+    }
+
+    // 没有更多 IDAT 块时返回 0，出错返回 -1
+    int read(char *buffer, int maxSize)
+    {
+        while (m_remaining == 0) {
+            // 上一块的 CRC，以及下一块的长度和类型
+            uchar header[12];
+            if (m_device->read(reinterpret_cast<char *>(header), 12) != 12) {
+                return -1;
+            }
+            if (memcmp(header + 8, "IDAT", 4) != 0) {
+                return 0;
+            }
+            m_remaining = qFromBigEndian<quint32>(header + 4);
+        }
+
+        const qint64 count = m_device->read(buffer, qMin<qint64>(maxSize, m_remaining));
+        if (count <= 0) {
+            return -1;
+        }
+        m_remaining -= static_cast<quint32>(count);
+        return static_cast<int>(count);
+    }
+
+private:
+    QIODevice *m_device;
+    quint32 m_remaining;
+};
+
+inline uchar paeth(int a, int b, int c)
+{
+    const int p = a + b - c;
+    const int pa = std::abs(p - a);
+    const int pb = std::abs(p - b);
+    const int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) {
+        return uchar(a);
+    }
+    return uchar(pb <= pc ? b : c);
+}
+
+// row[0] 是滤波类型，prior 是已经还原的上一行(不含滤波类型字节)
+bool unfilterRow(uchar *row, const uchar *prior, int rowBytes, int bpp)
+{
+    uchar *current = row + 1;
+    switch (row[0]) {
+    case 0:
+        break;
+    case 1:
+        for (int i = bpp; i < rowBytes; i++) {
+            current[i] = uchar(current[i] + current[i - bpp]);
+        }
+        break;
+    case 2:
+        for (int i = 0; i < rowBytes; i++) {
+            current[i] = uchar(current[i] + prior[i]);
+        }
+        break;
+    case 3:
+        for (int i = 0; i < bpp; i++) {
+            current[i] = uchar(current[i] + (prior[i] >> 1));
+        }
+        for (int i = bpp; i < rowBytes; i++) {
+            current[i] = uchar(current[i] + ((current[i - bpp] + prior[i]) >> 1));
+        }
+        break;
+    case 4:
+        for (int i = 0; i < bpp; i++) {
+            current[i] = uchar(current[i] + prior[i]);
+        }
+        for (int i = bpp; i < rowBytes; i++) {
+            current[i] = uchar(current[i] + paeth(current[i - bpp], prior[i], prior[i - bpp]));
+        }
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+void convertRows(const uchar *source, int stride, uchar *destination, int bytesPerLine,
+                 int rows, int width, int colorType)
+{
+    for (int y = 0; y < rows; y++) {
+        const uchar *s = source + qint64(y) * stride + 1;
+        uchar *line = destination + qint64(y) * bytesPerLine;
+        QRgb *d = reinterpret_cast<QRgb *>(line);
+        switch (colorType) {
+        case PngGray:
+        case PngPalette:
+            memcpy(line, s, static_cast<size_t>(width));
+            break;
+        case PngGrayAlpha:
+            for (int x = 0; x < width; x++, s += 2) {
+                d[x] = qRgba(s[0], s[0], s[0], s[1]);
+            }
+            break;
+        case PngRgb:
+            for (int x = 0; x < width; x++, s += 3) {
+                d[x] = qRgb(s[0], s[1], s[2]);
+            }
+            break;
+        case PngRgba:
+            for (int x = 0; x < width; x++, s += 4) {
+                d[x] = qRgba(s[0], s[1], s[2], s[3]);
+            }
+            break;
+        }
+    }
+}
+
+struct RowRange
+{
+    int first;
+    int count;
+};
+
+QImage decodePng(QIODevice *device, const QAtomicInt *cancelled)
+{
+    PngLayout layout;
+    quint32 idatLength = 0;
+    if (!readPngHeader(device, &layout, &idatLength) || qint64(layout.width) * layout.height < MinPixels) {
+        return QImage();
+    }
+
+    // 与 Qt 的 PNG 解码器得到的格式一致
+    QImage::Format format = QImage::Format_ARGB32;
+    if (layout.colorType == PngGray) {
+        format = QImage::Format_Grayscale8;
+    } else if (layout.colorType == PngPalette) {
+        format = QImage::Format_Indexed8;
+    } else if (layout.colorType == PngRgb) {
+        format = QImage::Format_RGB32;
+    }
+    QImage image(layout.width, layout.height, format);
+    if (image.isNull()) {
+        return QImage();
+    }
+    if (layout.colorType == PngPalette) {
+        // 损坏的文件中可能有超出调色板的索引
+        QVector<QRgb> colorTable = layout.palette;
+        while (colorTable.count() < 256) {
+            colorTable.append(qRgb(0, 0, 0));
+        }
+        image.setColorTable(colorTable);
+    }
+    uchar *bits = image.bits();
+    const int bytesPerLine = image.bytesPerLine();
+
+    const int rowBytes = layout.width * layout.channels;
+    const int stride = rowBytes + 1;
+    const int blockRows = qMax(1, PngBlockBytes / stride);
+    QByteArray blocks[2] = {
+        QByteArray(blockRows * stride, Qt::Uninitialized),
+        QByteArray(blockRows * stride, Qt::Uninitialized)
+    };
+    // 上一块的最后一行，只由反滤波任务读写，各任务依次执行
+    QByteArray prior(rowBytes, '\0');
+    const int threadCount = qMax(1, QThread::idealThreadCount());
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit(&stream) != Z_OK) {
+        return QImage();
+    }
+
+    IdatStream idat(device, idatLength);
+    QByteArray input(PngInputBytes, Qt::Uninitialized);
+    QFuture<bool> pending;
+    bool hasPending = false;
+    bool ok = true;
+
+    for (int top = 0, index = 0; ok && top < layout.height; top += blockRows, index++) {
+        const int rows = qMin(blockRows, layout.height - top);
+        uchar *block = reinterpret_cast<uchar *>(blocks[index % 2].data());
+
+        stream.next_out = block;
+        stream.avail_out = static_cast<uInt>(rows * stride);
+        while (stream.avail_out > 0) {
+            if (stream.avail_in == 0) {
+                const int count = idat.read(input.data(), input.size());
+                if (count <= 0) {
+                    ok = false;
+                    break;
+                }
+                stream.next_in = reinterpret_cast<Bytef *>(input.data());
+                stream.avail_in = static_cast<uInt>(count);
+            }
+            const int result = inflate(&stream, Z_NO_FLUSH);
+            if (result == Z_STREAM_END) {
+                ok = stream.avail_out == 0;
+                break;
+            }
+            if (result != Z_OK) {
+                ok = false;
+                break;
+            }
+        }
+
+        // 反滤波依赖上一块的结果，等上一块处理完再开始这一块
+        if (hasPending) {
+            ok = pending.result() && ok;
+        }
+        if (!ok || isCancelled(cancelled)) {
+            ok = false;
+            hasPending = false;
+            break;
+        }
+
+        uchar *destination = bits + qint64(top) * bytesPerLine;
+        pending = QtConcurrent::run([&layout, &prior, block, destination, rows, rowBytes, stride,
+                                     bytesPerLine, threadCount]() {
+            for (int y = 0; y < rows; y++) {
+                uchar *row = block + qint64(y) * stride;
+                const uchar *previous = y == 0 ? reinterpret_cast<const uchar *>(prior.constData())
+                                               : row - stride + 1;
+                if (!unfilterRow(row, previous, rowBytes, layout.channels)) {
+                    return false;
+                }
+            }
+            memcpy(prior.data(), block + qint64(rows - 1) * stride + 1, static_cast<size_t>(rowBytes));
+
+            QVector<RowRange> ranges;
+            const int rangeRows = qMax(1, (rows + threadCount - 1) / threadCount);
+            for (int first = 0; first < rows; first += rangeRows) {
+                ranges.append(RowRange { first, qMin(rangeRows, rows - first) });
+            }
+            QtConcurrent::blockingMap(ranges, [&](const RowRange &range) {
+                convertRows(block + qint64(range.first) * stride, stride,
+                            destination + qint64(range.first) * bytesPerLine, bytesPerLine,
+                            range.count, layout.width, layout.colorType);
+            });
+            return true;
+        });
+        hasPending = true;
+    }
+
+    // 正在执行的任务还引用着局部变量，必须等它结束
+    if (hasPending) {
+        ok = pending.result() && ok;
+    }
+    inflateEnd(&stream);
+
+    if (!ok || isCancelled(cancelled)) {
+        return QImage();
+    }
+    return image;
+}
+
+} // namespace
+
+QImage ParallelDecoder::decode(QIODevice *device, const QByteArray &format, const QAtomicInt *cancelled)
+{
+    if (!device || isCancelled(cancelled)) {
+        return QImage();
+    }
+
+    const qint64 position = device->pos();
+    QImage image;
+    if (format == "jpeg") {
+        image = decodeJpeg(device, cancelled);
+    } else if (format == "png") {
+        image = decodePng(device, cancelled);
+    }
+    device->seek(position);
+    return image;
+}
@@ -0,0 +1,30 @@
+#ifndef PARALLELDECODER_H
+#define PARALLELDECODER_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QImage>
+
+QT_BEGIN_NAMESPACE
+class QIODevice;
+QT_END_NAMESPACE
+
+/**
+ * @brief 用多个线程解码单张很大的图片
+ *
+ * JPEG：带重启间隔(DRI)的基线 JPEG 中，各重启段的熵编码数据互相独立。按整行 MCU 把重启段分组，
+ * 每组拼成一个只有这几行的小 JPEG，各自在一个线程中解码，直接写入目标图片对应的行。
+ *
+ * PNG：inflate 和逐行反滤波都只能顺序进行，这里把它们做成流水线：一个线程解压下一块数据的同时，
+ * 另一个线程对上一块反滤波，再把像素格式转换分给多个线程。
+ */
+class ParallelDecoder
+{
+public:
+    // 不适合并行解码(格式不支持、图片不够大、使用了不支持的编码特性)时返回空图片，
+    // 调用方应改用 QImageReader。无论成功与否，device 都会回到调用前的位置。
+    // 返回的图片尚未按 EXIF 方向旋转
+    static QImage decode(QIODevice *device, const QByteArray &format, const QAtomicInt *cancelled = nullptr);
+};
+
+#endif // PARALLELDECODER_H
@@ -0,0 +1,68 @@
+#include "pipelinestats.h"
+
+PipelineStats *PipelineStats::instance()
+{
+    static PipelineStats stats;
+    return &stats;
+}
+
+void PipelineStats::recordDecode(qint64 ioUs, qint64 decodeUs)
+{
+    m_lastIoUs.storeRelease(static_cast<int>(ioUs));
+    m_lastDecodeUs.storeRelease(static_cast<int>(decodeUs));
+}
+
+void PipelineStats::recordUpload(qint64 uploadUs)
+{
+    m_lastUploadUs.storeRelease(static_cast<int>(uploadUs));
+}
+
+void PipelineStats::recordCacheLookup(Cache cache, bool hit)
+{
+    m_cacheLookups[cache].ref();
+    if (hit) {
+        m_cacheHits[cache].ref();
+    }
+}
+
+int PipelineStats::lastIoUs() const
+{
+    return m_lastIoUs.loadAcquire();
+}
+
+int PipelineStats::lastDecodeUs() const
+{
+    return m_lastDecodeUs.loadAcquire();
+}
+
+int PipelineStats::lastUploadUs() const
+{
+    return m_lastUploadUs.loadAcquire();
+}
+
+int PipelineStats::cacheHits(Cache cache) const
+{
+    return m_cacheHits[cache].loadAcquire();
+}
+
+int PipelineStats::cacheLookups(Cache cache) const
+{
+    return m_cacheLookups[cache].loadAcquire();
+}
+
+const char *PipelineStats::cacheName(Cache cache)
+{
+    switch (cache) {
+    case FormatCache:
+        return "format";
+    case ThumbnailCache:
+        return "thumbnail";
+    case SlideshowPrefetch:
+        return "prefetch";
+    case DecodedCache:
+        return "decoded";
+    case CacheCount:
+        break;
+    }
+    return "";
+}
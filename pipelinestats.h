@@ -0,0 +1,46 @@
+#ifndef PIPELINESTATS_H
+#define PIPELINESTATS_H
+
+#include <QAtomicInt>
+
+/**
+ * @brief 图片加载流程中的各项计数：最近一次解码的耗时和缓存命中率
+ *
+ * 各模块在任意线程中记录，GraphicsView 的 HUD 读取显示。
+ */
+class PipelineStats
+{
+public:
+    static PipelineStats *instance();
+
+    enum Cache {
+        FormatCache,       // FormatDispatcher 的格式探测结果
+        ThumbnailCache,    // NavigationLoader 的缩略图
+        SlideshowPrefetch, // 幻灯片播放时下一张是否已经解码完成
+        DecodedCache,      // ImageCache 的热层和冷层
+        CacheCount
+    };
+
+    void recordDecode(qint64 ioUs, qint64 decodeUs);
+    void recordUpload(qint64 uploadUs);
+    void recordCacheLookup(Cache cache, bool hit);
+
+    int lastIoUs() const;
+    int lastDecodeUs() const;
+    int lastUploadUs() const;
+    int cacheHits(Cache cache) const;
+    int cacheLookups(Cache cache) const;
+
+    static const char *cacheName(Cache cache);
+
+private:
+    PipelineStats() = default;
+
+    QAtomicInt m_lastIoUs;
+    QAtomicInt m_lastDecodeUs;
+    QAtomicInt m_lastUploadUs;
+    QAtomicInt m_cacheHits[CacheCount];
+    QAtomicInt m_cacheLookups[CacheCount];
+};
+
+#endif // PIPELINESTATS_H
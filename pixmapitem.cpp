@@ -0,0 +1,27 @@
+#include "pixmapitem.h"
+
+#include "glviewport.h"
+
+#include <QStyleOptionGraphicsItem>
+
+PixmapItem::PixmapItem(const QPixmap &pixmap, QGraphicsItem *parent)
+    : QGraphicsPixmapItem(pixmap, parent)
+{
+    setShapeMode(QGraphicsPixmapItem::BoundingRectShape);
+    // 需要 exposedRect，只绘制可见的纹理块
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+}
+
+void PixmapItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+    GLViewport *viewport = qobject_cast<GLViewport *>(widget);
+    if (viewport) {
+        const QPixmap image(pixmap());
+        const QRectF target(offset(), QSizeF(image.size()) / image.devicePixelRatioF());
+        if (viewport->drawPixmap(painter, target, image, transformationMode(), option->exposedRect)) {
+            return;
+        }
+    }
+
+    QGraphicsPixmapItem::paint(painter, option, widget);
+}
@@ -0,0 +1,19 @@
+#ifndef PIXMAPITEM_H
+#define PIXMAPITEM_H
+
+#include <QGraphicsPixmapItem>
+
+/**
+ * @brief 场景中显示图片的项，在 GLViewport 中用纹理绘制，其它视口中与 QGraphicsPixmapItem 相同
+ *
+ * 类型仍然是 QGraphicsPixmapItem，qgraphicsitem_cast 不受影响。
+ */
+class PixmapItem : public QGraphicsPixmapItem
+{
+public:
+    explicit PixmapItem(const QPixmap &pixmap, QGraphicsItem *parent = nullptr);
+
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
+};
+
+#endif // PIXMAPITEM_H
@@ -0,0 +1,282 @@
+#include "pngstripeencoder.h"
+
+#include <QIODevice>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QtEndian>
+#include <QVector>
+
+#include <zlib.h>
+
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+enum PngFilter {
+    FilterNone,
+    FilterSub,
+    FilterUp,
+    FilterAverage,
+    FilterPaeth,
+    FilterCount
+};
+
+struct Stripe
+{
+    int        firstRow = 0;
+    int        rowCount = 0;
+    bool       last = false;
+    QByteArray compressed;
+    uLong      adler = 0;
+    uLong      length = 0;
+    bool       ok = false;
+};
+
+inline uchar paethPredictor(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) {
+        return static_cast<uchar>(a);
+    }
+    return static_cast<uchar>(pb <= pc ? b : c);
+}
+
+// 与 libpng 的默认策略相同：对每一行分别尝试五种滤波，选择差值绝对值之和最小的
+void filterRow(const uchar *row, const uchar *prev, int rowBytes, int bpp, uchar *out, uchar *scratch)
+{
+    uchar *best = out + 1;
+    long bestSum = -1;
+
+    for (int filter = FilterNone; filter < FilterCount; filter++) {
+        uchar *dst = (filter == FilterNone) ? best : scratch;
+        long sum = 0;
+        for (int i = 0; i < rowBytes; i++) {
+            int a = i >= bpp ? row[i - bpp] : 0;
+            int b = prev ? prev[i] : 0;
+            int c = (prev && i >= bpp) ? prev[i - bpp] : 0;
+            uchar predicted = 0;
+            switch (filter) {
+            case FilterSub:     predicted = static_cast<uchar>(a); break;
+            case FilterUp:      predicted = static_cast<uchar>(b); break;
+            case FilterAverage: predicted = static_cast<uchar>((a + b) / 2); break;
+            case FilterPaeth:   predicted = paethPredictor(a, b, c); break;
+            default: break;
+            }
+            uchar value = static_cast<uchar>(row[i] - predicted);
+            dst[i] = value;
+            sum += value < 128 ? value : 256 - value;
+        }
+
+        if (bestSum < 0 || sum < bestSum) {
+            bestSum = sum;
+            out[0] = static_cast<uchar>(filter);
+            if (dst != best) {
+                memcpy(best, dst, static_cast<size_t>(rowBytes));
+            }
+        }
+    }
+}
+
+bool deflateStripe(const QByteArray &input, bool last, int level, QByteArray *output)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // 负的 windowBits 表示输出不带 zlib 头尾的原始 deflate 数据
+    if (deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+
+    output->resize(static_cast<int>(deflateBound(&stream, static_cast<uLong>(input.size()))) + 16);
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.constData()));
+    stream.avail_in = static_cast<uInt>(input.size());
+    stream.next_out = reinterpret_cast<Bytef *>(output->data());
+    stream.avail_out = static_cast<uInt>(output->size());
+
+    int ret = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    bool ok = last ? (ret == Z_STREAM_END) : (ret == Z_OK && stream.avail_in == 0);
+    output->resize(static_cast<int>(stream.total_out));
+    deflateEnd(&stream);
+
+    return ok;
+}
+
+class StripeTask : public QRunnable
+{
+public:
+    StripeTask(const QImage &image, int bpp, int level, Stripe *stripe,
+               const QAtomicInt *cancelled, QAtomicInt *finishedCount,
+               const PngStripeEncoder::ProgressCallback &progress, int total)
+        : m_image(image)
+        , m_bpp(bpp)
+        , m_level(level)
+        , m_stripe(stripe)
+        , m_cancelled(cancelled)
+        , m_finishedCount(finishedCount)
+        , m_progress(progress)
+        , m_total(total)
+    {
+    }
+
+    void run() override
+    {
+        const int rowBytes = m_image.width() * m_bpp;
+        QByteArray filtered(m_stripe->rowCount * (rowBytes + 1), Qt::Uninitialized);
+        QByteArray scratch(rowBytes, Qt::Uninitialized);
+
+        for (int i = 0; i < m_stripe->rowCount; i++) {
+            if (m_cancelled && m_cancelled->loadAcquire()) {
+                return;
+            }
+            int y = m_stripe->firstRow + i;
+            filterRow(m_image.constScanLine(y), y > 0 ? m_image.constScanLine(y - 1) : nullptr,
+                      rowBytes, m_bpp,
+                      reinterpret_cast<uchar *>(filtered.data()) + i * (rowBytes + 1),
+                      reinterpret_cast<uchar *>(scratch.data()));
+        }
+
+        m_stripe->adler = adler32(adler32(0L, Z_NULL, 0),
+                                  reinterpret_cast<const Bytef *>(filtered.constData()),
+                                  static_cast<uInt>(filtered.size()));
+        m_stripe->length = static_cast<uLong>(filtered.size());
+        m_stripe->ok = deflateStripe(filtered, m_stripe->last, m_level, &m_stripe->compressed);
+
+        int done = m_finishedCount->fetchAndAddOrdered(1) + 1;
+        if (m_progress) {
+            m_progress(done, m_total);
+        }
+    }
+
+private:
+    const QImage &m_image;
+    int m_bpp;
+    int m_level;
+    Stripe *m_stripe;
+    const QAtomicInt *m_cancelled;
+    QAtomicInt *m_finishedCount;
+    const PngStripeEncoder::ProgressCallback &m_progress;
+    int m_total;
+};
+
+bool writeChunk(QIODevice *device, const char *type, const QByteArray &data)
+{
+    uchar length[4];
+    qToBigEndian<quint32>(static_cast<quint32>(data.size()), length);
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, reinterpret_cast<const Bytef *>(type), 4);
+    crc = crc32(crc, reinterpret_cast<const Bytef *>(data.constData()), static_cast<uInt>(data.size()));
+    uchar crcBytes[4];
+    qToBigEndian<quint32>(static_cast<quint32>(crc), crcBytes);
+
+    return device->write(reinterpret_cast<const char *>(length), 4) == 4
+            && device->write(type, 4) == 4
+            && device->write(data) == data.size()
+            && device->write(reinterpret_cast<const char *>(crcBytes), 4) == 4;
+}
+
+QByteArray bigEndianBytes(quint32 value)
+{
+    QByteArray bytes(4, Qt::Uninitialized);
+    qToBigEndian<quint32>(value, reinterpret_cast<uchar *>(bytes.data()));
+    return bytes;
+}
+
+} // namespace
+
+bool PngStripeEncoder::encode(const QImage &image, QIODevice *device, int compressionLevel,
+                              const QAtomicInt *cancelled, ProgressCallback progress)
+{
+    if (image.isNull() || !device) {
+        return false;
+    }
+
+    const bool hasAlpha = image.hasAlphaChannel();
+    const QImage source = image.convertToFormat(hasAlpha ? QImage::Format_RGBA8888 : QImage::Format_RGB888);
+    const int bpp = hasAlpha ? 4 : 3;
+    const int rowBytes = source.width() * bpp;
+
+    // 条带大小在 256 KB 到 8 MB 之间，并且数量足够让每个线程分到几条
+    const int threadCount = qMax(1, QThread::idealThreadCount());
+    const int minRows = qMax(1, (256 * 1024) / (rowBytes + 1));
+    const int maxRows = qMax(minRows, (8 * 1024 * 1024) / (rowBytes + 1));
+    const int stripeRows = qBound(minRows, (source.height() + threadCount * 4 - 1) / (threadCount * 4), maxRows);
+
+    QVector<Stripe> stripes;
+    for (int y = 0; y < source.height(); y += stripeRows) {
+        Stripe stripe;
+        stripe.firstRow = y;
+        stripe.rowCount = qMin(stripeRows, source.height() - y);
+        stripes.append(stripe);
+    }
+    stripes.last().last = true;
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threadCount);
+    QAtomicInt finishedCount(0);
+    for (int i = 0; i < stripes.count(); i++) {
+        pool.start(new StripeTask(source, bpp, compressionLevel, &stripes[i],
+                                  cancelled, &finishedCount, progress, stripes.count()));
+    }
+    pool.waitForDone();
+
+    if (cancelled && cancelled->loadAcquire()) {
+        return false;
+    }
+
+    QByteArray header("\x89PNG\r\n\x1a\n", 8);
+    if (device->write(header) != header.size()) {
+        return false;
+    }
+
+    QByteArray ihdr;
+    ihdr.append(bigEndianBytes(static_cast<quint32>(source.width())));
+    ihdr.append(bigEndianBytes(static_cast<quint32>(source.height())));
+    ihdr.append(char(8));                 // bit depth
+    ihdr.append(char(hasAlpha ? 6 : 2));  // color type: RGBA / RGB
+    ihdr.append(char(0));                 // compression
+    ihdr.append(char(0));                 // filter
+    ihdr.append(char(0));                 // interlace
+    if (!writeChunk(device, "IHDR", ihdr)) {
+        return false;
+    }
+
+    if (image.dotsPerMeterX() > 0 && image.dotsPerMeterY() > 0) {
+        QByteArray phys;
+        phys.append(bigEndianBytes(static_cast<quint32>(image.dotsPerMeterX())));
+        phys.append(bigEndianBytes(static_cast<quint32>(image.dotsPerMeterY())));
+        phys.append(char(1)); // 单位：米
+        if (!writeChunk(device, "pHYs", phys)) {
+            return false;
+        }
+    }
+
+    uLong adler = adler32(0L, Z_NULL, 0);
+    for (int i = 0; i < stripes.count(); i++) {
+        const Stripe &stripe = stripes.at(i);
+        if (!stripe.ok) {
+            return false;
+        }
+        adler = adler32_combine(adler, stripe.adler, static_cast<z_off_t>(stripe.length));
+
+        // 每个条带写成一个 IDAT 块，第一个带上 zlib 头，最后一个带上 adler32
+        QByteArray data;
+        if (i == 0) {
+            data.append(char(0x78));
+            data.append(char(0x9c));
+        }
+        data.append(stripe.compressed);
+        if (stripe.last) {
+            data.append(bigEndianBytes(static_cast<quint32>(adler)));
+        }
+        if (!writeChunk(device, "IDAT", data)) {
+            return false;
+        }
+    }
+
+    return writeChunk(device, "IEND", QByteArray());
+}
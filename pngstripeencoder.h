@@ -0,0 +1,28 @@
+#ifndef PNGSTRIPEENCODER_H
+#define PNGSTRIPEENCODER_H
+
+#include <QAtomicInt>
+#include <QImage>
+
+#include <functional>
+
+QT_BEGIN_NAMESPACE
+class QIODevice;
+QT_END_NAMESPACE
+
+/**
+ * @brief 多线程 PNG 编码
+ *
+ * 图片按行分成若干条带，各条带的滤波和 deflate 压缩并行进行，除最后一条外都以
+ * Z_SYNC_FLUSH 结束，按顺序拼接后就是一个完整的 zlib 数据流，adler32 分别计算后再合并。
+ */
+class PngStripeEncoder
+{
+public:
+    typedef std::function<void(int done, int total)> ProgressCallback;
+
+    static bool encode(const QImage &image, QIODevice *device, int compressionLevel = 6,
+                       const QAtomicInt *cancelled = nullptr, ProgressCallback progress = ProgressCallback());
+};
+
+#endif // PNGSTRIPEENCODER_H
@@ -0,0 +1,88 @@
+#include "regionloader.h"
+
+#include "imageloader.h"
+#include "taskscheduler.h"
+
+#include <QFutureWatcher>
+
+RegionLoader::RegionLoader(QObject *parent)
+    : QObject(parent)
+    , m_cancelled(new QAtomicInt(0))
+{
+}
+
+void RegionLoader::setFilePath(const QString &filePath)
+{
+    cancel();
+    m_filePath = filePath;
+}
+
+QString RegionLoader::filePath() const
+{
+    return m_filePath;
+}
+
+void RegionLoader::request(const QRect &region, const QSize &scaledSize)
+{
+    if (m_filePath.isEmpty() || region.isEmpty() || scaledSize.isEmpty()) {
+        return;
+    }
+
+    if (m_busy) {
+        m_pendingRegion = region;
+        m_pendingSize = scaledSize;
+        return;
+    }
+
+    startDecode(region, scaledSize);
+}
+
+void RegionLoader::cancel()
+{
+    // 正在解码的区域完成后被丢弃
+    m_generation++;
+    m_cancelled->storeRelease(1);
+    m_cancelled.reset(new QAtomicInt(0));
+    m_busy = false;
+    m_pendingRegion = QRect();
+    m_pendingSize = QSize();
+}
+
+void RegionLoader::startDecode(const QRect &region, const QSize &scaledSize)
+{
+    m_busy = true;
+
+    const int generation = m_generation;
+    const QString filePath(m_filePath);
+    const QSharedPointer<QAtomicInt> cancelled(m_cancelled);
+    QFutureWatcher<QImage> *watcher = new QFutureWatcher<QImage>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, generation, region]() {
+        watcher->deleteLater();
+        onDecodeFinished(generation, region, watcher->result());
+    });
+
+    watcher->setFuture(TaskScheduler::instance()->run(TaskScheduler::Interaction,
+                                                      [filePath, region, scaledSize, cancelled]() {
+        return ImageLoader::decodeRegion(filePath, region, scaledSize, cancelled.data());
+    }, cancelled));
+}
+
+void RegionLoader::onDecodeFinished(int generation, const QRect &region, const QImage &image)
+{
+    if (generation != m_generation) {
+        return;
+    }
+    m_busy = false;
+
+    if (!image.isNull()) {
+        emit regionReady(region, image);
+    }
+
+    if (!m_pendingRegion.isEmpty()) {
+        const QRect pendingRegion = m_pendingRegion;
+        const QSize pendingSize = m_pendingSize;
+        m_pendingRegion = QRect();
+        m_pendingSize = QSize();
+        startDecode(pendingRegion, pendingSize);
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef REGIONLOADER_H
+#define REGIONLOADER_H
+
+#include <QAtomicInt>
+#include <QImage>
+#include <QObject>
+#include <QRect>
+#include <QSharedPointer>
+
+/**
+ * @brief 很大的图片放大查看时，在后台只解码可见的区域
+ *
+ * 同一时间只解码一个区域。解码期间的新请求只保留最后一个，当前区域解码完成后再开始。
+ */
+class RegionLoader : public QObject
+{
+    Q_OBJECT
+public:
+    explicit RegionLoader(QObject *parent = nullptr);
+
+    // 切换文件(或传入空路径)时取消正在进行的解码，结果会被丢弃
+    void setFilePath(const QString &filePath);
+    QString filePath() const;
+
+    // region 为图片的像素坐标，scaledSize 为解码后的大小
+    void request(const QRect &region, const QSize &scaledSize);
+    void cancel();
+
+signals:
+    void regionReady(const QRect &region, const QImage &image);
+
+private:
+    void startDecode(const QRect &region, const QSize &scaledSize);
+    void onDecodeFinished(int generation, const QRect &region, const QImage &image);
+
+    QString m_filePath;
+    int m_generation = 0;
+    bool m_busy = false;
+    QSharedPointer<QAtomicInt> m_cancelled;
+    QRect m_pendingRegion;
+    QSize m_pendingSize;
+};
+
+#endif // REGIONLOADER_H
@@ -2,8 +2,35 @@
 
 #include <QApplication>
 #include <QStandardPaths>
+#include <QSettings>
 #include <QDebug>
 #include <QDir>
+#include <QtConcurrent>
+
+namespace {
+
+struct DoubleClickBehaviorName
+{
+    DoubleClickBehavior behavior;
+    const char *name;
+};
+
+const DoubleClickBehaviorName doubleClickBehaviorNames[] = {
+    { ActionCloseWindow,    "close"    },
+    { ActionMaximizeWindow, "maximize" },
+    { ActionDoNothing,      "ignore"   },
+};
+
+void writeValues(const QString &configFilePath, const QVariantMap &values)
+{
+    QSettings settings(configFilePath, QSettings::IniFormat);
+    for (QVariantMap::const_iterator it = values.constBegin(); it != values.constEnd(); ++it) {
+        settings.setValue(it.key(), it.value());
+    }
+    settings.sync();
+}
+
+} // namespace
 
 Settings *Settings::m_settings_instance = nullptr;
 
@@ -15,49 +42,113 @@ Settings *Settings::instance()
     return m_settings_instance;
 }
 
-bool Settings::stayOnTop()
+void Settings::setStayOnTop(bool on)
+{
+    if (m_stayOnTop == on) {
+        return;
+    }
+    m_stayOnTop = on;
+    scheduleWrite("stay_on_top", on);
+    emit stayOnTopChanged(on);
+}
+
+void Settings::setSingleInstance(bool on)
 {
-    return m_qsettings->value("stay_on_top").toBool();
+    if (m_singleInstance == on) {
+        return;
+    }
+    m_singleInstance = on;
+    scheduleWrite("single_instance", on);
+    emit singleInstanceChanged(on);
 }
 
-DoubleClickBehavior Settings::doubleClickBehavior()
+void Settings::setSlideshowInterval(int msec)
 {
-    QString result = m_qsettings->value("double_click_behavior", "close").toString().toLower();
-    return stringToDoubleClickBehavior(result);
+    if (m_slideshowInterval == msec) {
+        return;
+    }
+    m_slideshowInterval = msec;
+    scheduleWrite("slideshow_interval", msec);
+    emit slideshowIntervalChanged(msec);
 }
 
-void Settings::setStayOnTop(bool on)
+void Settings::setSlideshowCrossfade(bool on)
+{
+    if (m_slideshowCrossfade == on) {
+        return;
+    }
+    m_slideshowCrossfade = on;
+    scheduleWrite("slideshow_crossfade", on);
+    emit slideshowCrossfadeChanged(on);
+}
+
+void Settings::setOpenGLViewport(bool on)
 {
-    m_qsettings->setValue("stay_on_top", on);
-    m_qsettings->sync();
+    if (m_openGLViewport == on) {
+        return;
+    }
+    m_openGLViewport = on;
+    scheduleWrite("opengl_viewport", on);
+    emit openGLViewportChanged(on);
 }
 
 void Settings::setDoubleClickBehavior(DoubleClickBehavior dcb)
 {
-    m_qsettings->setValue("double_click_behavior", doubleClickBehaviorToString(dcb));
-    m_qsettings->sync();
+    if (m_doubleClickBehavior == dcb) {
+        return;
+    }
+    m_doubleClickBehavior = dcb;
+    scheduleWrite("double_click_behavior", doubleClickBehaviorToString(dcb));
+    emit doubleClickBehaviorChanged(dcb);
+}
+
+void Settings::flush()
+{
+    m_writeTimer.stop();
+    m_writerPool.waitForDone();
+
+    if (!m_pending.isEmpty()) {
+        writeValues(m_configFilePath, m_pending);
+        m_pending.clear();
+    }
 }
 
 QString Settings::doubleClickBehaviorToString(DoubleClickBehavior dcb)
 {
-    static QMap<DoubleClickBehavior, QString> _map {
-        {ActionCloseWindow,   "close"},
-        {ActionMaximizeWindow, "maximize"},
-        {ActionDoNothing,      "ignore"}
-    };
+    for (const DoubleClickBehaviorName &entry : doubleClickBehaviorNames) {
+        if (entry.behavior == dcb) {
+            return QLatin1String(entry.name);
+        }
+    }
+
+    return QStringLiteral("close");
+}
+
+DoubleClickBehavior Settings::stringToDoubleClickBehavior(const QString &str)
+{
+    for (const DoubleClickBehaviorName &entry : doubleClickBehaviorNames) {
+        if (str == QLatin1String(entry.name)) {
+            return entry.behavior;
+        }
+    }
+
+    return ActionCloseWindow;
+}
 
-    return _map.value(dcb, "close");
+void Settings::scheduleWrite(const QString &key, const QVariant &value)
+{
+    m_pending.insert(key, value);
+    m_writeTimer.start();
 }
 
-DoubleClickBehavior Settings::stringToDoubleClickBehavior(QString str)
+void Settings::writePending()
 {
-    static QMap<QString, DoubleClickBehavior> _map {
-        {"close",    ActionCloseWindow},
-        {"maximize", ActionMaximizeWindow},
-        {"ignore",   ActionDoNothing}
-    };
+    if (m_pending.isEmpty()) {
+        return;
+    }
 
-    return _map.value(str, ActionCloseWindow);
+    QtConcurrent::run(&m_writerPool, writeValues, m_configFilePath, m_pending);
+    m_pending.clear();
 }
 
 Settings::Settings() : QObject(qApp)
@@ -77,5 +168,20 @@ Settings::Settings() : QObject(qApp)
         configPath = QStandardPaths::writableLocation(QStandardPaths::ConfigLocation);
     }
 
-    m_qsettings = new QSettings(QDir(configPath).absoluteFilePath("config.ini"), QSettings::IniFormat, this);
+    m_configFilePath = QDir(configPath).absoluteFilePath("config.ini");
+
+    QSettings settings(m_configFilePath, QSettings::IniFormat);
+    m_stayOnTop = settings.value("stay_on_top", m_stayOnTop).toBool();
+    m_singleInstance = settings.value("single_instance", m_singleInstance).toBool();
+    m_slideshowInterval = settings.value("slideshow_interval", m_slideshowInterval).toInt();
+    m_slideshowCrossfade = settings.value("slideshow_crossfade", m_slideshowCrossfade).toBool();
+    m_openGLViewport = settings.value("opengl_viewport", m_openGLViewport).toBool();
+    m_doubleClickBehavior = stringToDoubleClickBehavior(
+                settings.value("double_click_behavior", "close").toString().toLower());
+
+    m_writerPool.setMaxThreadCount(1);
+    m_writeTimer.setSingleShot(true);
+    m_writeTimer.setInterval(500);
+    connect(&m_writeTimer, &QTimer::timeout, this, &Settings::writePending);
+    connect(qApp, &QCoreApplication::aboutToQuit, this, &Settings::flush);
 }
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <QObject>
-#include <QSettings>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVariantMap>
 
 enum DoubleClickBehavior {
     ActionDoNothing,
@@ -12,24 +14,63 @@ enum DoubleClickBehavior {
     ActionEnd = ActionMaximizeWindow
 };
 
+/**
+ * @brief 程序配置
+ *
+ * 启动时一次性读入内存，读取只是普通的字段访问；修改后发出对应的信号，
+ * 并在短暂延迟后合并写入磁盘，写入在后台线程中进行。
+ */
 class Settings : public QObject
 {
     Q_OBJECT
 public:
     static Settings *instance();
 
-    bool stayOnTop();
-    DoubleClickBehavior doubleClickBehavior();
+    bool stayOnTop() const { return m_stayOnTop; }
+    bool singleInstance() const { return m_singleInstance; }
+    int slideshowInterval() const { return m_slideshowInterval; }
+    bool slideshowCrossfade() const { return m_slideshowCrossfade; }
+    bool openGLViewport() const { return m_openGLViewport; }
+    DoubleClickBehavior doubleClickBehavior() const { return m_doubleClickBehavior; }
 
     void setStayOnTop(bool on);
+    void setSingleInstance(bool on);
+    void setSlideshowInterval(int msec);
+    void setSlideshowCrossfade(bool on);
+    void setOpenGLViewport(bool on);
     void setDoubleClickBehavior(DoubleClickBehavior dcb);
 
+    // 立即把尚未写入的修改写入磁盘，程序退出前调用
+    void flush();
+
     static QString doubleClickBehaviorToString(DoubleClickBehavior dcb);
-    static DoubleClickBehavior stringToDoubleClickBehavior(QString str);
+    static DoubleClickBehavior stringToDoubleClickBehavior(const QString &str);
+
+signals:
+    void stayOnTopChanged(bool on);
+    void singleInstanceChanged(bool on);
+    void slideshowIntervalChanged(int msec);
+    void slideshowCrossfadeChanged(bool on);
+    void openGLViewportChanged(bool on);
+    void doubleClickBehaviorChanged(DoubleClickBehavior dcb);
 
 private:
     Settings();
 
+    void scheduleWrite(const QString &key, const QVariant &value);
+    void writePending();
+
     static Settings *m_settings_instance;
-    QSettings *m_qsettings;
+
+    bool m_stayOnTop = false;
+    bool m_singleInstance = false;
+    int m_slideshowInterval = 3000;
+    bool m_slideshowCrossfade = true;
+    bool m_openGLViewport = false;
+    DoubleClickBehavior m_doubleClickBehavior = ActionCloseWindow;
+
+    QString m_configFilePath;
+    QVariantMap m_pending;
+    QTimer m_writeTimer;
+    QThreadPool m_writerPool; // 只有一个线程，保证写入按顺序进行
 };
@@ -1,15 +1,21 @@
 #include "settingsdialog.h"
 
+#include "glviewport.h"
 #include "settings.h"
 
 #include <QCheckBox>
 #include <QComboBox>
 #include <QFormLayout>
+#include <QSpinBox>
 #include <QStringListModel>
 
 SettingsDialog::SettingsDialog(QWidget *parent)
     : QDialog(parent)
     , m_stayOntop(new QCheckBox)
+    , m_singleInstance(new QCheckBox)
+    , m_slideshowInterval(new QSpinBox)
+    , m_slideshowCrossfade(new QCheckBox)
+    , m_openGLViewport(new QCheckBox)
     , m_doubleClickBehavior(new QComboBox)
 {
     QFormLayout *settingsForm = new QFormLayout(this);
@@ -26,9 +32,20 @@ SettingsDialog::SettingsDialog(QWidget *parent)
     }
 
     settingsForm->addRow(tr("Stay on top when start-up"), m_stayOntop);
+    settingsForm->addRow(tr("Open images in the running instance"), m_singleInstance);
     settingsForm->addRow(tr("Double-click behavior"), m_doubleClickBehavior);
+    settingsForm->addRow(tr("Slideshow interval"), m_slideshowInterval);
+    settingsForm->addRow(tr("Crossfade between slides"), m_slideshowCrossfade);
+    settingsForm->addRow(tr("Render with OpenGL"), m_openGLViewport);
 
     m_stayOntop->setChecked(Settings::instance()->stayOnTop());
+    m_singleInstance->setChecked(Settings::instance()->singleInstance());
+    m_slideshowInterval->setRange(1, 60);
+    m_slideshowInterval->setSuffix(tr(" s"));
+    m_slideshowInterval->setValue(Settings::instance()->slideshowInterval() / 1000);
+    m_slideshowCrossfade->setChecked(Settings::instance()->slideshowCrossfade());
+    m_openGLViewport->setChecked(Settings::instance()->openGLViewport());
+    m_openGLViewport->setEnabled(GLViewport::isAvailable());
     m_doubleClickBehavior->setModel(new QStringListModel(dropDown));
     DoubleClickBehavior dcb = Settings::instance()->doubleClickBehavior();
     m_doubleClickBehavior->setCurrentIndex(static_cast<int>(dcb));
@@ -37,6 +54,22 @@ SettingsDialog::SettingsDialog(QWidget *parent)
         Settings::instance()->setStayOnTop(state == Qt::Checked);
     });
 
+    connect(m_singleInstance, &QCheckBox::stateChanged, this, [ = ](int state){
+        Settings::instance()->setSingleInstance(state == Qt::Checked);
+    });
+
+    connect(m_slideshowInterval, QOverload<int>::of(&QSpinBox::valueChanged), this, [ = ](int seconds){
+        Settings::instance()->setSlideshowInterval(seconds * 1000);
+    });
+
+    connect(m_slideshowCrossfade, &QCheckBox::stateChanged, this, [ = ](int state){
+        Settings::instance()->setSlideshowCrossfade(state == Qt::Checked);
+    });
+
+    connect(m_openGLViewport, &QCheckBox::stateChanged, this, [ = ](int state){
+        Settings::instance()->setOpenGLViewport(state == Qt::Checked);
+    });
+
     connect(m_doubleClickBehavior, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [=](int index){
         Settings::instance()->setDoubleClickBehavior(static_cast<DoubleClickBehavior>(index));
     });
@@ -7,6 +7,7 @@
 
 class QCheckBox;
 class QComboBox;
+class QSpinBox;
 
 class SettingsDialog : public QDialog
 {
@@ -17,6 +18,10 @@ public:
 
 private:
     QCheckBox *m_stayOntop = nullptr;
+    QCheckBox *m_singleInstance = nullptr;
+    QSpinBox  *m_slideshowInterval = nullptr;
+    QCheckBox *m_slideshowCrossfade = nullptr;
+    QCheckBox *m_openGLViewport = nullptr;
     QComboBox *m_doubleClickBehavior = nullptr;
 };
 
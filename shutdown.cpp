@@ -0,0 +1,23 @@
+#include "shutdown.h"
+
+#include "settings.h"
+#include "taskscheduler.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+void Shutdown::flushPersistentState()
+{
+    TaskScheduler::instance()->shutdown();
+    Settings::instance()->flush();
+}
+
+void Shutdown::exitProcess(int exitCode)
+{
+    flushPersistentState();
+
+    // _Exit 不会刷新 stdio 的缓冲区
+    fflush(stdout);
+    fflush(stderr);
+    std::_Exit(exitCode);
+}
@@ -0,0 +1,21 @@
+#ifndef SHUTDOWN_H
+#define SHUTDOWN_H
+
+#include <QtGlobal>
+
+/**
+ * @brief 快速退出：窗口关闭后只保存需要持久化的状态，然后直接结束进程
+ *
+ * 场景、解码后的图片和各级缓存占用的内存由操作系统一次性回收，不再逐个析构释放；
+ * 后台任务被取消，不等待它们结束。正在进行的导出不在此列，MainWindow 关闭前会等待它结束。
+ */
+class Shutdown
+{
+public:
+    // 保存配置，取消后台任务
+    static void flushPersistentState();
+    // 调用 flushPersistentState() 后以 exitCode 结束进程，不执行析构函数
+    Q_NORETURN static void exitProcess(int exitCode);
+};
+
+#endif // SHUTDOWN_H
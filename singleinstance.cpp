@@ -0,0 +1,125 @@
+#include "singleinstance.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QLocalServer>
+#include <QLocalSocket>
+
+namespace {
+
+const int  SocketTimeout = 500; // ms
+const char AckByte       = '\x06';
+
+} // namespace
+
+SingleInstance::SingleInstance(QObject *parent)
+    : QObject(parent)
+    , m_server(new QLocalServer(this))
+{
+    connect(m_server, &QLocalServer::newConnection, this, [this]() {
+        while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+            connect(socket, &QLocalSocket::readyRead, this, [this, socket]() {
+                readMessage(socket);
+            });
+            connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+        }
+    });
+}
+
+bool SingleInstance::sendToRunningInstance(const QList<QUrl> &urls)
+{
+    QLocalSocket socket;
+    socket.connectToServer(serverName());
+    if (!socket.waitForConnected(SocketTimeout)) {
+        return false;
+    }
+
+    QStringList urlStrList;
+    for (const QUrl &url : urls) {
+        urlStrList.append(url.toString());
+    }
+
+    QByteArray block;
+    QDataStream out(&block, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_12);
+    out << urlStrList;
+
+    socket.write(block);
+    if (!socket.waitForBytesWritten(SocketTimeout)) {
+        return false;
+    }
+
+    // 等待对方确认，避免把文件交给一个已经卡死的实例
+    if (!socket.waitForReadyRead(SocketTimeout)) {
+        return false;
+    }
+
+    return socket.read(1) == QByteArray(1, AckByte);
+}
+
+bool SingleInstance::listen()
+{
+    if (m_server->listen(serverName())) {
+        return true;
+    }
+
+    if (m_server->serverError() != QAbstractSocket::AddressInUseError) {
+        return false;
+    }
+
+    // 上一个实例崩溃后可能会残留 socket 文件。只有确认没有进程在监听时才删除，
+    // 正忙的实例没有及时确认时不能抢走它的 socket，这时本实例不监听
+    QLocalSocket probe;
+    probe.connectToServer(serverName());
+    if (probe.waitForConnected(SocketTimeout)) {
+        probe.abort();
+        return false;
+    }
+    if (probe.error() != QLocalSocket::ServerNotFoundError
+            && probe.error() != QLocalSocket::ConnectionRefusedError) {
+        return false;
+    }
+
+    QLocalServer::removeServer(serverName());
+    return m_server->listen(serverName());
+}
+
+void SingleInstance::close()
+{
+    m_server->close();
+}
+
+QString SingleInstance::serverName()
+{
+    // 每个用户使用各自的 server
+    QByteArray userHash = QCryptographicHash::hash(QDir::homePath().toUtf8(), QCryptographicHash::Md5);
+    return QStringLiteral("pineapple-pictures-") + QString::fromLatin1(userHash.toHex().left(8));
+}
+
+void SingleInstance::readMessage(QLocalSocket *socket)
+{
+    QStringList urlStrList;
+
+    QDataStream in(socket);
+    in.setVersion(QDataStream::Qt_5_12);
+    in.startTransaction();
+    in >> urlStrList;
+    if (!in.commitTransaction()) {
+        // 数据还没有接收完整
+        return;
+    }
+
+    QList<QUrl> urls;
+    for (const QString &str : urlStrList) {
+        QUrl url(str);
+        if (url.isValid()) {
+            urls.append(url);
+        }
+    }
+
+    socket->write(QByteArray(1, AckByte));
+    socket->flush();
+
+    emit urlsReceived(urls);
+}
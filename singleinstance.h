@@ -0,0 +1,38 @@
+#ifndef SINGLEINSTANCE_H
+#define SINGLEINSTANCE_H
+
+#include <QObject>
+#include <QUrl>
+
+QT_BEGIN_NAMESPACE
+class QLocalServer;
+class QLocalSocket;
+QT_END_NAMESPACE
+
+/**
+ * @brief 单实例模式：新启动的进程把文件列表交给已经在运行的实例处理
+ */
+class SingleInstance : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SingleInstance(QObject *parent = nullptr);
+
+    static bool sendToRunningInstance(const QList<QUrl> &urls);
+
+    // 已有实例在运行(即使没有及时响应)时返回 false，不影响它的 socket
+    bool listen();
+    // 退出时尽早停止监听，之后启动的进程不会再把文件交给正在退出的实例
+    void close();
+
+signals:
+    void urlsReceived(const QList<QUrl> &urls);
+
+private:
+    static QString serverName();
+    void readMessage(QLocalSocket *socket);
+
+    QLocalServer *m_server;
+};
+
+#endif // SINGLEINSTANCE_H
@@ -0,0 +1,282 @@
+#include "slideshow.h"
+
+#include "imageloader.h"
+#include "pipelinestats.h"
+#include "taskscheduler.h"
+
+#include <QDebug>
+#include <QFutureWatcher>
+#include <QPainter>
+#include <QTimer>
+#include <QVariantAnimation>
+
+const int Slideshow::PrefetchDepth;
+const int Slideshow::MaxDegradeLevel;
+
+Slideshow::Slideshow(QObject *parent)
+    : QObject(parent)
+    , m_timer(new QTimer(this))
+    , m_crossfade(new QVariantAnimation(this))
+{
+    m_timer->setSingleShot(true);
+    m_timer->setTimerType(Qt::PreciseTimer);
+    connect(m_timer, &QTimer::timeout, this, &Slideshow::advance);
+
+    m_crossfade->setStartValue(0.0);
+    m_crossfade->setEndValue(1.0);
+    connect(m_crossfade, &QVariantAnimation::valueChanged, this, [this](const QVariant &value) {
+        blend(value.toReal());
+    });
+}
+
+void Slideshow::start(const QList<QUrl> &files, int currentIndex, const QSize &displaySize)
+{
+    stop();
+
+    if (files.count() < 2 || currentIndex < 0 || currentIndex >= files.count()) {
+        return;
+    }
+
+    m_files = files;
+    m_currentIndex = currentIndex;
+    m_displaySize = displaySize;
+    m_degradeLevel = 0;
+    m_lateFrameCount = 0;
+    m_running = true;
+
+    schedulePrefetch();
+
+    m_clock.start();
+    m_nextDeadline = m_interval;
+    m_timer->start(m_interval);
+}
+
+void Slideshow::stop()
+{
+    if (!m_running) {
+        return;
+    }
+
+    m_running = false;
+    m_waitingForFrame = false;
+    // 还在解码的结果到达后会被丢弃
+    m_generation++;
+    m_timer->stop();
+    m_crossfade->stop();
+    m_pendingLevels.clear();
+    m_ready.clear();
+    m_files.clear();
+    m_fadeFrom = QImage();
+    m_currentImage = QImage();
+    updateMemoryUsage();
+}
+
+bool Slideshow::isRunning() const
+{
+    return m_running;
+}
+
+void Slideshow::setInterval(int msec)
+{
+    m_interval = qMax(msec, 100);
+    m_crossfade->setDuration(qMin(400, m_interval / 3));
+}
+
+void Slideshow::setCrossfadeEnabled(bool enabled)
+{
+    m_crossfadeEnabled = enabled;
+}
+
+int Slideshow::lateFrameCount() const
+{
+    return m_lateFrameCount;
+}
+
+int Slideshow::nextIndex() const
+{
+    return (m_currentIndex + 1) % m_files.count();
+}
+
+bool Slideshow::isInPrefetchWindow(int index) const
+{
+    int distance = (index - m_currentIndex + m_files.count()) % m_files.count();
+    return distance > 0 && distance <= PrefetchDepth;
+}
+
+QSize Slideshow::targetSize(int degradeLevel) const
+{
+    return m_displaySize / (1 << degradeLevel);
+}
+
+void Slideshow::updateMemoryUsage()
+{
+    qint64 bytes = ImageMemory::bytesOf(m_currentImage) + ImageMemory::bytesOf(m_fadeFrom);
+    for (const Frame &frame : m_ready) {
+        bytes += ImageMemory::bytesOf(frame.image);
+    }
+    m_memory.setBytes(bytes);
+}
+
+void Slideshow::schedulePrefetch()
+{
+    for (QHash<int, Frame>::iterator it = m_ready.begin(); it != m_ready.end();) {
+        if (isInPrefetchWindow(it.key())) {
+            ++it;
+        } else {
+            it = m_ready.erase(it);
+        }
+    }
+
+    int depth = qMin(PrefetchDepth, m_files.count() - 1);
+    for (int i = 1; i <= depth; i++) {
+        int index = (m_currentIndex + i) % m_files.count();
+        if (!m_ready.contains(index) && !m_pendingLevels.contains(index)) {
+            launchDecode(index, m_degradeLevel);
+        }
+    }
+
+    updateMemoryUsage();
+}
+
+void Slideshow::launchDecode(int index, int degradeLevel)
+{
+    const QString filePath = m_files.at(index).toLocalFile();
+    const QSize size = targetSize(degradeLevel);
+    const QSize displaySize = m_displaySize;
+    const int generation = m_generation;
+
+    m_pendingLevels.insert(index, qMax(degradeLevel, m_pendingLevels.value(index, 0)));
+
+    QFutureWatcher<Frame> *watcher = new QFutureWatcher<Frame>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, index, generation]() {
+        watcher->deleteLater();
+        if (generation == m_generation) {
+            onDecodeFinished(index, watcher->result());
+        }
+    });
+
+    watcher->setFuture(TaskScheduler::instance()->run(TaskScheduler::Neighbor, [filePath, size, displaySize, degradeLevel]() {
+        QElapsedTimer timer;
+        timer.start();
+        Frame frame;
+        frame.image = ImageLoader::decode(filePath, size);
+        frame.degradeLevel = degradeLevel;
+        frame.decodeMs = timer.elapsed();
+        // 全分辨率解码时的大小：原图缩小到不超过显示尺寸，小图保持原大小
+        frame.displaySize = frame.image.size();
+        if (degradeLevel > 0) {
+            const QSize imageSize = ImageLoader::imageSize(filePath);
+            if (imageSize.isValid()) {
+                frame.displaySize = imageSize.boundedTo(displaySize) == imageSize
+                        ? imageSize : imageSize.scaled(displaySize, Qt::KeepAspectRatio);
+            }
+        }
+        return frame;
+    }));
+}
+
+void Slideshow::onDecodeFinished(int index, const Frame &frame)
+{
+    if (frame.degradeLevel >= m_pendingLevels.value(index, 0)) {
+        m_pendingLevels.remove(index);
+    }
+
+    // 解码速度足够快时逐步恢复分辨率
+    if (m_degradeLevel > 0 && frame.degradeLevel == m_degradeLevel && frame.decodeMs * 3 < m_interval) {
+        m_degradeLevel--;
+    }
+
+    if (!isInPrefetchWindow(index)) {
+        return;
+    }
+
+    // 先到的帧先用，不用更低分辨率的结果覆盖已有的帧
+    if (!m_ready.contains(index) || m_ready.value(index).degradeLevel > frame.degradeLevel) {
+        m_ready.insert(index, frame);
+        updateMemoryUsage();
+    }
+
+    if (m_waitingForFrame && index == nextIndex()) {
+        qint64 lateMs = m_clock.elapsed() - m_nextDeadline;
+        qWarning() << "Slideshow: frame" << index << "was" << lateMs << "ms late, decoding at 1 /"
+                   << (1 << m_degradeLevel) << "of display size now";
+
+        m_waitingForFrame = false;
+        m_nextDeadline = m_clock.elapsed();
+        present(index);
+    }
+}
+
+void Slideshow::advance()
+{
+    int index = nextIndex();
+    const bool ready = m_ready.contains(index);
+    PipelineStats::instance()->recordCacheLookup(PipelineStats::SlideshowPrefetch, ready);
+    if (ready) {
+        present(index);
+        return;
+    }
+
+    // 解码跟不上播放间隔：降低后续的解码分辨率，并为这一张追加一个低分辨率的解码，哪个先完成就显示哪个
+    m_waitingForFrame = true;
+    m_lateFrameCount++;
+    if (m_degradeLevel < MaxDegradeLevel) {
+        m_degradeLevel++;
+    }
+    if (m_pendingLevels.value(index, -1) < m_degradeLevel) {
+        launchDecode(index, m_degradeLevel);
+    }
+}
+
+void Slideshow::present(int index)
+{
+    const Frame frame = m_ready.take(index);
+    m_currentIndex = index;
+
+    m_crossfade->stop();
+    m_fadeFrom = m_currentImage;
+    m_currentImage = frame.image;
+
+    emit frameReady(index, frame.image, frame.displaySize);
+
+    if (m_crossfadeEnabled && !m_fadeFrom.isNull() && !m_currentImage.isNull()) {
+        blend(0);
+        m_crossfade->start();
+    }
+
+    schedulePrefetch();
+
+    // 以计划时间为基准计算下一次切换，避免误差累积
+    m_nextDeadline += m_interval;
+    m_timer->start(static_cast<int>(qMax<qint64>(0, m_nextDeadline - m_clock.elapsed())));
+}
+
+void Slideshow::blend(qreal progress)
+{
+    if (m_fadeFrom.isNull() || m_currentImage.isNull()) {
+        return;
+    }
+
+    // 两张图都已经是显示尺寸，在新图片的大小上混合
+    QImage blended(m_currentImage.size(), QImage::Format_ARGB32_Premultiplied);
+    blended.fill(Qt::transparent);
+
+    QSize fromSize = m_fadeFrom.size().scaled(blended.size(), Qt::KeepAspectRatio);
+    QRect fromRect(QPoint((blended.width() - fromSize.width()) / 2,
+                          (blended.height() - fromSize.height()) / 2), fromSize);
+
+    QPainter painter(&blended);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    painter.setOpacity(1.0 - progress);
+    painter.drawImage(fromRect, m_fadeFrom);
+    painter.setOpacity(progress);
+    painter.drawImage(0, 0, m_currentImage);
+    painter.end();
+
+    emit blendFrameReady(blended);
+
+    if (progress >= 1.0) {
+        m_fadeFrom = QImage();
+        updateMemoryUsage();
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef SLIDESHOW_H
+#define SLIDESHOW_H
+
+#include "imagememory.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QImage>
+#include <QObject>
+#include <QUrl>
+
+QT_BEGIN_NAMESPACE
+class QTimer;
+class QVariantAnimation;
+QT_END_NAMESPACE
+
+/**
+ * @brief 幻灯片播放
+ *
+ * 在后台提前解码接下来的几张图片(按显示尺寸缩放)，到点后直接切换。
+ * 解码跟不上播放间隔时会降低预解码的分辨率，而不是卡住等待。
+ */
+class Slideshow : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Slideshow(QObject *parent = nullptr);
+
+    static const int PrefetchDepth = 3;
+    static const int MaxDegradeLevel = 2; // 最低降到显示尺寸的 1/4
+
+    void start(const QList<QUrl> &files, int currentIndex, const QSize &displaySize);
+    void stop();
+    bool isRunning() const;
+
+    void setInterval(int msec);
+    void setCrossfadeEnabled(bool enabled);
+
+    int lateFrameCount() const;
+
+signals:
+    // displaySize 是这一帧在屏幕上应占的大小，降低分辨率解码的帧比它小，显示时需要放大
+    void frameReady(int index, const QImage &image, const QSize &displaySize);
+    void blendFrameReady(const QImage &image);
+
+private:
+    struct Frame {
+        QImage image;
+        int    degradeLevel = 0;
+        qint64 decodeMs = 0;
+        QSize  displaySize;
+    };
+
+    int nextIndex() const;
+    bool isInPrefetchWindow(int index) const;
+    QSize targetSize(int degradeLevel) const;
+    void updateMemoryUsage();
+
+    void schedulePrefetch();
+    void launchDecode(int index, int degradeLevel);
+    void onDecodeFinished(int index, const Frame &frame);
+    void advance();
+    void present(int index);
+    void blend(qreal progress);
+
+    QList<QUrl> m_files;
+    int m_currentIndex = -1;
+    int m_interval = 3000;
+    int m_degradeLevel = 0;
+    int m_generation = 0;
+    int m_lateFrameCount = 0;
+    bool m_running = false;
+    bool m_crossfadeEnabled = true;
+    bool m_waitingForFrame = false;
+    QSize m_displaySize;
+
+    QElapsedTimer m_clock;
+    qint64 m_nextDeadline = 0;
+    QTimer *m_timer;
+    QVariantAnimation *m_crossfade;
+    QImage m_fadeFrom;
+    QImage m_currentImage;
+    ImageMemoryTicket m_memory { ImageMemory::Slideshow };
+
+    QHash<int, int> m_pendingLevels; // 正在解码的图片 -> 其中最低的分辨率等级
+    QHash<int, Frame> m_ready;
+};
+
+#endif // SLIDESHOW_H
@@ -0,0 +1,77 @@
+#include "startuptimer.h"
+
+#include <QAbstractScrollArea>
+#include <QDebug>
+#include <QEvent>
+#include <QTimer>
+#include <QWidget>
+
+StartupTimer *StartupTimer::instance()
+{
+    static StartupTimer timer;
+    return &timer;
+}
+
+void StartupTimer::start()
+{
+    m_phases.clear();
+    m_lastMark = 0;
+    m_timer.start();
+}
+
+void StartupTimer::setReportEnabled(bool enabled)
+{
+    m_reportEnabled = enabled;
+}
+
+void StartupTimer::mark(const QString &phase)
+{
+    if (!m_timer.isValid()) {
+        return;
+    }
+
+    qint64 elapsed = m_timer.elapsed();
+    m_phases.append(qMakePair(phase, elapsed - m_lastMark));
+    m_lastMark = elapsed;
+}
+
+void StartupTimer::reportAfterFirstPaint(QWidget *widget)
+{
+    if (!m_reportEnabled || !widget) {
+        return;
+    }
+
+    // 对于 QGraphicsView 这类控件，实际的绘制发生在 viewport 上
+    QAbstractScrollArea *scrollArea = qobject_cast<QAbstractScrollArea *>(widget);
+    m_watchedWidget = scrollArea ? scrollArea->viewport() : widget;
+    m_watchedWidget->installEventFilter(this);
+}
+
+bool StartupTimer::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched == m_watchedWidget && event->type() == QEvent::Paint) {
+        m_watchedWidget->removeEventFilter(this);
+        m_watchedWidget = nullptr;
+        // 等这一次绘制完成后再统计
+        QTimer::singleShot(0, this, [this]() {
+            mark(QStringLiteral("first paint"));
+            report();
+        });
+    }
+
+    return QObject::eventFilter(watched, event);
+}
+
+void StartupTimer::report()
+{
+    for (const QPair<QString, qint64> &phase : m_phases) {
+        qInfo().noquote() << QStringLiteral("startup: %1 %2 ms")
+                             .arg(phase.first, -16).arg(phase.second, 5);
+    }
+
+    qInfo().noquote() << QStringLiteral("startup: %1 %2 ms (target %3 ms)")
+                         .arg(QStringLiteral("total"), -16).arg(m_lastMark, 5).arg(TargetMs);
+    if (m_lastMark > TargetMs) {
+        qWarning().noquote() << QStringLiteral("startup: exceeded target by %1 ms").arg(m_lastMark - TargetMs);
+    }
+}
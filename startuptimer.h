@@ -0,0 +1,45 @@
+#ifndef STARTUPTIMER_H
+#define STARTUPTIMER_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QPair>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+class QWidget;
+QT_END_NAMESPACE
+
+/**
+ * @brief 记录启动各阶段的耗时，使用 --startup-timings 参数时在首帧绘制后输出
+ */
+class StartupTimer : public QObject
+{
+    Q_OBJECT
+public:
+    static StartupTimer *instance();
+
+    // 启动耗时目标(毫秒)，超出时输出警告
+    static const qint64 TargetMs = 250;
+
+    void start();
+    void setReportEnabled(bool enabled);
+    void mark(const QString &phase);
+    void reportAfterFirstPaint(QWidget *widget);
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+    StartupTimer() = default;
+
+    void report();
+
+    QElapsedTimer m_timer;
+    qint64 m_lastMark = 0;
+    QVector<QPair<QString, qint64> > m_phases;
+    bool m_reportEnabled = false;
+    QWidget *m_watchedWidget = nullptr;
+};
+
+#endif // STARTUPTIMER_H
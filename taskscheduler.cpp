@@ -0,0 +1,211 @@
+#include "taskscheduler.h"
+
+#include <QMutexLocker>
+#include <QThread>
+
+namespace {
+
+// 当前线程在调度器中的编号，不是工作线程时为 -1
+thread_local int currentWorker = -1;
+
+} // namespace
+
+TaskScheduler *TaskScheduler::instance()
+{
+    static TaskScheduler scheduler;
+    return &scheduler;
+}
+
+TaskScheduler::TaskScheduler()
+    : m_nextWorker(0)
+{
+    const int count = qMax(2, QThread::idealThreadCount());
+    for (int i = 0; i < count; i++) {
+        Worker *worker = new Worker;
+        worker->urgentOnly = i == 0;
+        m_workers.append(worker);
+    }
+
+    for (int i = 0; i < count; i++) {
+        m_workers[i]->thread = QThread::create([this, i]() {
+            workerLoop(i);
+        });
+        m_workers[i]->thread->setObjectName(QStringLiteral("TaskScheduler %1").arg(i));
+        m_workers[i]->thread->start();
+    }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    shutdown();
+
+    for (Worker *worker : qAsConst(m_workers)) {
+        worker->thread->wait();
+        delete worker->thread;
+    }
+    qDeleteAll(m_workers);
+}
+
+void TaskScheduler::shutdown()
+{
+    {
+        QMutexLocker locker(&m_sleepMutex);
+        m_stopping = true;
+        m_wake.wakeAll();
+    }
+
+    // 正在执行的任务尽快结束，排队的任务全部丢弃
+    QVector<Task> discarded;
+    for (Worker *worker : qAsConst(m_workers)) {
+        QMutexLocker locker(&worker->mutex);
+        if (worker->runningToken) {
+            worker->runningToken->storeRelease(1);
+        }
+        for (std::deque<Task> &queue : worker->queues) {
+            for (const Task &task : queue) {
+                discarded.append(task);
+            }
+            queue.clear();
+        }
+    }
+    for (const Task &task : qAsConst(discarded)) {
+        task.discard();
+    }
+}
+
+void TaskScheduler::setPriority(const CancellationToken &token, Priority priority)
+{
+    if (!token) {
+        return;
+    }
+
+    for (Worker *worker : qAsConst(m_workers)) {
+        QMutexLocker locker(&worker->mutex);
+        for (int p = 0; p < PriorityCount; p++) {
+            if (p == priority) {
+                continue;
+            }
+            std::deque<Task> &queue = worker->queues[p];
+            for (std::deque<Task>::iterator it = queue.begin(); it != queue.end();) {
+                if (it->token == token) {
+                    worker->queues[priority].push_back(*it);
+                    it = queue.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+    }
+
+    wakeWorkers();
+}
+
+int TaskScheduler::workerCount() const
+{
+    return m_workers.count();
+}
+
+void TaskScheduler::enqueue(Priority priority, const Task &task)
+{
+    // 工作线程中提交的任务放进自己的队列，其它线程提交的轮流分配
+    int index = currentWorker;
+    if (index < 0) {
+        index = static_cast<int>(static_cast<uint>(m_nextWorker.fetchAndAddRelaxed(1)) % uint(m_workers.count()));
+    }
+
+    {
+        // 持有 m_sleepMutex 入队，shutdown() 之后不会再有任务留在队列中
+        QMutexLocker locker(&m_sleepMutex);
+        if (m_stopping) {
+            locker.unlock();
+            task.discard();
+            return;
+        }
+
+        Worker *worker = m_workers.at(index);
+        QMutexLocker workerLocker(&worker->mutex);
+        worker->queues[priority].push_back(task);
+    }
+
+    wakeWorkers();
+}
+
+bool TaskScheduler::takeTask(int index, Task *task)
+{
+    const int count = m_workers.count();
+    const int lowest = m_workers.at(index)->urgentOnly ? Interaction : PriorityCount - 1;
+
+    for (int p = 0; p <= lowest; p++) {
+        // 自己的队列从尾部取，最近提交的任务最可能还需要
+        {
+            Worker *own = m_workers.at(index);
+            QMutexLocker locker(&own->mutex);
+            if (!own->queues[p].empty()) {
+                *task = own->queues[p].back();
+                own->queues[p].pop_back();
+                return true;
+            }
+        }
+
+        // 同一优先级的任务从其它线程的队列头部窃取，不先去执行自己更低优先级的任务
+        for (int i = 1; i < count; i++) {
+            Worker *victim = m_workers.at((index + i) % count);
+            QMutexLocker locker(&victim->mutex);
+            if (!victim->queues[p].empty()) {
+                *task = victim->queues[p].front();
+                victim->queues[p].pop_front();
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void TaskScheduler::workerLoop(int index)
+{
+    currentWorker = index;
+    Worker *worker = m_workers.at(index);
+
+    for (;;) {
+        quint64 sequence;
+        {
+            QMutexLocker locker(&m_sleepMutex);
+            if (m_stopping) {
+                return;
+            }
+            sequence = m_sequence;
+        }
+
+        Task task;
+        if (takeTask(index, &task)) {
+            if (task.token && task.token->loadAcquire()) {
+                task.discard();
+                continue;
+            }
+
+            {
+                QMutexLocker locker(&worker->mutex);
+                worker->runningToken = task.token;
+            }
+            task.run();
+            {
+                QMutexLocker locker(&worker->mutex);
+                worker->runningToken.reset();
+            }
+            continue;
+        }
+
+        QMutexLocker locker(&m_sleepMutex);
+        if (!m_stopping && sequence == m_sequence) {
+            m_wake.wait(&m_sleepMutex);
+        }
+    }
+}
+
+void TaskScheduler::wakeWorkers()
+{
+    QMutexLocker locker(&m_sleepMutex);
+    m_sequence++;
+    // 只为紧急任务保留的线程可能取不到新任务，全部唤醒
+    m_wake.wakeAll();
+}
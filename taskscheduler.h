@@ -0,0 +1,146 @@
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include <QAtomicInt>
+#include <QFuture>
+#include <QFutureInterface>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QVector>
+#include <QWaitCondition>
+
+#include <deque>
+#include <functional>
+
+QT_BEGIN_NAMESPACE
+class QThread;
+QT_END_NAMESPACE
+
+/**
+ * @brief 所有后台图片任务共用的按优先级调度的线程池
+ *
+ * 每个工作线程有自己的任务队列(每个优先级一个双端队列)。线程从自己队列的尾部取任务，
+ * 自己没有任务时从其它线程队列的头部窃取；无论取自哪里，总是先取最高优先级的任务。
+ * 另外保留一个线程只执行 VisibleImage 和 Interaction 的任务，当前图片的解码不会排在
+ * 一批缩略图后面。
+ *
+ * 任务开始前取消令牌已被置位时直接丢弃，QFuture 得到默认构造的结果。
+ * 一个任务内部的数据并行(如条带解码)仍使用 QtConcurrent 的全局线程池。
+ */
+class TaskScheduler
+{
+public:
+    enum Priority {
+        VisibleImage,   // 当前显示的图片
+        Interaction,    // 缩放、平移时的细化：可见区域解码、直方图
+        Neighbor,       // 图库中相邻的图片：预取、缓存升降级、导出
+        Thumbnail,      // 缩略图
+        Metadata,       // 页数、文件列表等元数据
+        PriorityCount
+    };
+
+    typedef QSharedPointer<QAtomicInt> CancellationToken;
+
+    static TaskScheduler *instance();
+    ~TaskScheduler();
+
+    // function 可以在任意工作线程中执行；token 非空时可以用 setPriority 调整尚未开始的任务
+    template <typename Function>
+    auto run(Priority priority, Function function, const CancellationToken &token = CancellationToken())
+        -> QFuture<decltype(function())>;
+
+    // 调整使用 token 的所有尚未开始的任务的优先级，用于用户切换图片后
+    void setPriority(const CancellationToken &token, Priority priority);
+
+    int workerCount() const;
+
+    // 程序退出时调用：置位正在执行的任务的取消令牌，丢弃排队的任务，之后提交的任务也直接丢弃。
+    // 不等待工作线程结束
+    void shutdown();
+
+private:
+    struct Task
+    {
+        std::function<void()> run;
+        std::function<void()> discard;
+        CancellationToken token;
+    };
+
+    struct Worker
+    {
+        QMutex mutex;
+        std::deque<Task> queues[PriorityCount];
+        CancellationToken runningToken;
+        QThread *thread = nullptr;
+        bool urgentOnly = false;
+    };
+
+    template <typename T>
+    struct Reporter
+    {
+        static void run(QFutureInterface<T> &future, const std::function<T()> &function)
+        {
+            future.reportResult(function());
+        }
+        static void discard(QFutureInterface<T> &future)
+        {
+            future.reportResult(T());
+        }
+    };
+
+    TaskScheduler();
+
+    void enqueue(Priority priority, const Task &task);
+    bool takeTask(int index, Task *task);
+    void workerLoop(int index);
+    void wakeWorkers();
+
+    QVector<Worker *> m_workers;
+    QAtomicInt m_nextWorker;
+
+    QMutex m_sleepMutex;
+    QWaitCondition m_wake;
+    quint64 m_sequence = 0;    // 每次有新任务时增加，避免线程在检查队列后错过唤醒
+    bool m_stopping = false;
+};
+
+template <>
+struct TaskScheduler::Reporter<void>
+{
+    static void run(QFutureInterface<void> &future, const std::function<void()> &function)
+    {
+        Q_UNUSED(future);
+        function();
+    }
+    static void discard(QFutureInterface<void> &future)
+    {
+        Q_UNUSED(future);
+    }
+};
+
+template <typename Function>
+auto TaskScheduler::run(Priority priority, Function function, const CancellationToken &token)
+    -> QFuture<decltype(function())>
+{
+    typedef decltype(function()) Result;
+
+    QSharedPointer<QFutureInterface<Result> > future(new QFutureInterface<Result>());
+    future->reportStarted();
+    const std::function<Result()> call(function);
+
+    Task task;
+    task.token = token;
+    task.run = [future, call]() {
+        Reporter<Result>::run(*future, call);
+        future->reportFinished();
+    };
+    task.discard = [future]() {
+        Reporter<Result>::discard(*future);
+        future->reportFinished();
+    };
+    enqueue(priority, task);
+
+    return future->future();
+}
+
+#endif // TASKSCHEDULER_H
@@ -0,0 +1,83 @@
+// 比较两次 tst_viewbenchmark 的 XML 结果：benchmarkcompare RESULTS BASELINE [TOLERANCE]
+// 任何一项比基准慢超过容差(百分比，默认 25)时返回非零值
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QMap>
+#include <QTextStream>
+#include <QXmlStreamReader>
+
+namespace {
+
+// 差值小于这个值(毫秒)时视为测量噪声，不算作变慢
+const double NoiseFloorMs = 0.02;
+
+// 键为 "测试函数/数据标签"，值为每次迭代的毫秒数
+bool readResults(const QString &filePath, QMap<QString, double> *results)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        QTextStream(stderr) << "Cannot read " << filePath << ": " << file.errorString() << '\n';
+        return false;
+    }
+
+    QXmlStreamReader xml(&file);
+    QString function;
+    while (!xml.atEnd()) {
+        if (xml.readNext() != QXmlStreamReader::StartElement) {
+            continue;
+        }
+        const QXmlStreamAttributes attributes = xml.attributes();
+        if (xml.name() == QLatin1String("TestFunction")) {
+            function = attributes.value(QLatin1String("name")).toString();
+        } else if (xml.name() == QLatin1String("BenchmarkResult")) {
+            results->insert(function + '/' + attributes.value(QLatin1String("tag")).toString(),
+                            attributes.value(QLatin1String("value")).toDouble());
+        }
+    }
+
+    if (xml.hasError()) {
+        QTextStream(stderr) << "Cannot parse " << filePath << ": " << xml.errorString() << '\n';
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const QStringList arguments = app.arguments();
+    if (arguments.count() < 3) {
+        QTextStream(stderr) << "Usage: benchmarkcompare RESULTS BASELINE [TOLERANCE]" << '\n';
+        return 2;
+    }
+
+    QMap<QString, double> results;
+    QMap<QString, double> baseline;
+    if (!readResults(arguments.at(1), &results) || !readResults(arguments.at(2), &baseline)) {
+        return 2;
+    }
+    const double tolerance = arguments.count() > 3 ? arguments.at(3).toDouble() / 100 : 0.25;
+
+    int regressions = 0;
+    QTextStream err(stderr);
+    for (QMap<QString, double>::const_iterator it = results.constBegin(); it != results.constEnd(); ++it) {
+        if (!baseline.contains(it.key())) {
+            continue;
+        }
+        const double before = baseline.value(it.key());
+        const double now = it.value();
+        if (now > before * (1 + tolerance) && now - before > NoiseFloorMs) {
+            err << "REGRESSION " << it.key() << ": " << before << " ms -> " << now << " ms" << '\n';
+            regressions++;
+        }
+    }
+
+    if (regressions > 0) {
+        err << regressions << " benchmark(s) slower than the baseline" << '\n';
+        return 1;
+    }
+    return 0;
+}
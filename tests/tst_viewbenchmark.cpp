@@ -0,0 +1,363 @@
+// 交互相关热点函数的性能测试
+//
+// 在 offscreen 平台上用不同尺寸和旋转角度的图片测量缩放、窗口大小变化、适应窗口、
+// 导航图更新和大图绘制的耗时，OpenGL 可用时再用 OpenGL 视口测量一遍(数据标签以 /gl 结尾)。
+// 退出耗时在子进程中测量：子进程打开并浏览几张大图，填满缓存后关闭窗口，记录从关闭到进程结束的时间。
+
+#include "glviewport.h"
+#include "graphicsscene.h"
+#include "graphicsview.h"
+#include "mainwindow.h"
+#include "navigatorview.h"
+#include "shutdown.h"
+
+#include <QApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QLinearGradient>
+#include <QMap>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLWidget>
+#include <QPainter>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QTextStream>
+#include <QTimer>
+#include <QUrl>
+#include <QVector>
+
+#include <algorithm>
+
+namespace {
+
+// 设置了这个环境变量时，进程作为退出耗时测试的子进程运行，变量的值为图片目录
+const char ExitProbeVariable[] = "PPIC_EXIT_PROBE";
+
+// 退出耗时：测量次数、子进程浏览的图片数和每张图片停留的时间
+const int ExitRuns = 3;
+const int ExitProbeImages = 5;
+const int ExitProbeStepMs = 500;
+const int ExitProbeTimeoutMs = 60 * 1000;
+
+QString sizeName(const QSize &size)
+{
+    return QStringLiteral("%1x%2").arg(size.width()).arg(size.height());
+}
+
+// 与 GraphicsView 内部的 resetWithScaleAndRotate() 效果相同，只使用公开的接口
+void setScaleAndRotation(GraphicsView &view, qreal scale, int angle)
+{
+    view.resetTransform();
+    view.rotateView(angle);
+    view.zoomView(scale);
+}
+
+// OpenGL 的绘制命令是异步执行的，计时要包含 GPU(或 llvmpipe)完成绘制的时间
+void finishRendering(QWidget *viewport)
+{
+    QOpenGLWidget *glWidget = qobject_cast<QOpenGLWidget *>(viewport);
+    if (glWidget && glWidget->context()) {
+        glWidget->makeCurrent();
+        glWidget->context()->functions()->glFinish();
+        glWidget->doneCurrent();
+    }
+}
+
+// 图片尺寸 × 旋转角度 × 视口类型，scale 大于 0 时每行还有缩放比例一列
+void addViewRows(qreal scale = 0)
+{
+    const QVector<QSize> imageSizes { QSize(1024, 768), QSize(4096, 3072), QSize(6000, 4000) };
+    const QVector<int> angles { 0, 90 };
+    QVector<bool> viewports { false };
+    if (GLViewport::isAvailable()) {
+        viewports.append(true);
+    }
+
+    for (bool openGL : viewports) {
+        for (const QSize &size : imageSizes) {
+            for (int angle : angles) {
+                const QString tag = (scale > 0 ? QStringLiteral("%1/").arg(scale) : QString())
+                        + QStringLiteral("%1/%2").arg(sizeName(size)).arg(angle)
+                        + (openGL ? QStringLiteral("/gl") : QString());
+                QTestData &row = QTest::newRow(qPrintable(tag)) << size << angle << openGL;
+                if (scale > 0) {
+                    row << scale;
+                }
+            }
+        }
+    }
+}
+
+struct ViewFixture
+{
+    ViewFixture(const QPixmap &pixmap, bool openGL)
+    {
+        view.setScene(&scene);
+        view.setOpenGLEnabled(openGL);
+        view.resize(1280, 800);
+        view.show();
+        scene.showImage(pixmap);
+
+        navigator.setFixedSize(220, 160);
+        navigator.setScene(&scene);
+        navigator.setMainView(&view);
+        navigator.setOpenGLEnabled(openGL);
+    }
+
+    GraphicsScene scene;
+    GraphicsView view;
+    NavigatorView navigator;
+};
+
+// 子进程：依次浏览每张图片，让解码结果和缓存都留在内存中，再像用户一样关闭窗口
+int runExitProbe(QApplication &app, const QString &directory)
+{
+    QList<QUrl> urls;
+    const QStringList names = QDir(directory).entryList({ QStringLiteral("*.jpg") }, QDir::Files, QDir::Name);
+    for (const QString &name : names) {
+        urls.append(QUrl::fromLocalFile(QDir(directory).absoluteFilePath(name)));
+    }
+
+    MainWindow window;
+    window.show();
+    window.showUrls(urls);
+
+    int step = 0;
+    QTimer timer;
+    timer.setInterval(ExitProbeStepMs);
+    QObject::connect(&timer, &QTimer::timeout, &window, [&window, &timer, &step, &urls]() {
+        if (++step < urls.count()) {
+            window.galleryNext();
+            return;
+        }
+        timer.stop();
+        QTextStream(stdout) << "ready" << '\n';
+        window.close();
+    });
+    timer.start();
+
+    Shutdown::exitProcess(app.exec());
+}
+
+} // namespace
+
+class ViewBenchmark : public QObject
+{
+    Q_OBJECT
+private slots:
+    void zoomView_data();
+    void zoomView();
+    void resizeEvent_data();
+    void resizeEvent();
+    void checkAndDoFitInView_data();
+    void checkAndDoFitInView();
+    void updateMainViewportRegion_data();
+    void updateMainViewportRegion();
+    void paint_data();
+    void paint();
+    void exitTime_data();
+    void exitTime();
+
+private:
+    QPixmap testPixmap(const QSize &size);
+
+    QMap<QString, QPixmap> m_pixmaps;
+};
+
+QPixmap ViewBenchmark::testPixmap(const QSize &size)
+{
+    const QString key = sizeName(size);
+    if (!m_pixmaps.contains(key)) {
+        QImage image(size, QImage::Format_RGB32);
+        QPainter painter(&image);
+        QLinearGradient gradient(0, 0, size.width(), size.height());
+        gradient.setColorAt(0, QColor(30, 60, 120));
+        gradient.setColorAt(1, QColor(240, 200, 80));
+        painter.fillRect(image.rect(), gradient);
+        painter.end();
+        m_pixmaps.insert(key, QPixmap::fromImage(image));
+    }
+    return m_pixmaps.value(key);
+}
+
+void ViewBenchmark::zoomView_data()
+{
+    QTest::addColumn<QSize>("imageSize");
+    QTest::addColumn<int>("angle");
+    QTest::addColumn<bool>("openGL");
+    addViewRows();
+}
+
+void ViewBenchmark::zoomView()
+{
+    QFETCH(QSize, imageSize);
+    QFETCH(int, angle);
+    QFETCH(bool, openGL);
+    ViewFixture fixture(testPixmap(imageSize), openGL);
+    setScaleAndRotation(fixture.view, 1, angle);
+
+    bool zoomIn = true;
+    QBENCHMARK {
+        fixture.view.zoomView(zoomIn ? 1.25 : 0.8);
+        zoomIn = !zoomIn;
+    }
+}
+
+void ViewBenchmark::resizeEvent_data()
+{
+    zoomView_data();
+}
+
+void ViewBenchmark::resizeEvent()
+{
+    QFETCH(QSize, imageSize);
+    QFETCH(int, angle);
+    QFETCH(bool, openGL);
+    ViewFixture fixture(testPixmap(imageSize), openGL);
+    setScaleAndRotation(fixture.view, 1, angle);
+    fixture.view.checkAndDoFitInView();
+
+    bool larger = true;
+    QBENCHMARK {
+        // 窗口可见时 resize 会立即发送 QResizeEvent
+        fixture.view.resize(larger ? QSize(1000, 700) : QSize(1280, 800));
+        larger = !larger;
+    }
+}
+
+void ViewBenchmark::checkAndDoFitInView_data()
+{
+    zoomView_data();
+}
+
+void ViewBenchmark::checkAndDoFitInView()
+{
+    QFETCH(QSize, imageSize);
+    QFETCH(int, angle);
+    QFETCH(bool, openGL);
+    ViewFixture fixture(testPixmap(imageSize), openGL);
+
+    // 每次都从放大的状态适应窗口，计时包含放大本身
+    QBENCHMARK {
+        setScaleAndRotation(fixture.view, 3, angle);
+        fixture.view.checkAndDoFitInView();
+    }
+}
+
+void ViewBenchmark::updateMainViewportRegion_data()
+{
+    zoomView_data();
+}
+
+void ViewBenchmark::updateMainViewportRegion()
+{
+    QFETCH(QSize, imageSize);
+    QFETCH(int, angle);
+    QFETCH(bool, openGL);
+    ViewFixture fixture(testPixmap(imageSize), openGL);
+    setScaleAndRotation(fixture.view, 2, angle);
+
+    QBENCHMARK {
+        fixture.navigator.updateMainViewportRegion();
+    }
+}
+
+void ViewBenchmark::paint_data()
+{
+    QTest::addColumn<QSize>("imageSize");
+    QTest::addColumn<int>("angle");
+    QTest::addColumn<bool>("openGL");
+    QTest::addColumn<qreal>("scale");
+
+    const qreal scales[] = { 0.25, 1, 3 };
+    for (qreal scale : scales) {
+        addViewRows(scale);
+    }
+}
+
+void ViewBenchmark::paint()
+{
+    QFETCH(QSize, imageSize);
+    QFETCH(int, angle);
+    QFETCH(bool, openGL);
+    QFETCH(qreal, scale);
+    ViewFixture fixture(testPixmap(imageSize), openGL);
+    setScaleAndRotation(fixture.view, scale, angle);
+
+    // 第一次绘制包含纹理上传，不计入
+    fixture.view.viewport()->repaint();
+    finishRendering(fixture.view.viewport());
+
+    QBENCHMARK {
+        fixture.view.viewport()->repaint();
+        finishRendering(fixture.view.viewport());
+    }
+}
+
+void ViewBenchmark::exitTime_data()
+{
+    QTest::addColumn<QSize>("imageSize");
+    QTest::newRow("6000x4000") << QSize(6000, 4000);
+}
+
+void ViewBenchmark::exitTime()
+{
+    QFETCH(QSize, imageSize);
+
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    const QImage image = testPixmap(imageSize).toImage();
+    for (int i = 0; i < ExitProbeImages; i++) {
+        QVERIFY(image.save(QDir(directory.path()).absoluteFilePath(QStringLiteral("%1.jpg").arg(i)), "jpg", 90));
+    }
+
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    environment.insert(QString::fromLatin1(ExitProbeVariable), directory.path());
+
+    QVector<qint64> samples;
+    for (int run = 0; run < ExitRuns; run++) {
+        QProcess probe;
+        probe.setProcessEnvironment(environment);
+        probe.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+        probe.start(QCoreApplication::applicationFilePath(), QStringList());
+
+        // 子进程关闭窗口前输出一行 ready
+        QElapsedTimer timer;
+        timer.start();
+        while (!probe.canReadLine() && timer.elapsed() < ExitProbeTimeoutMs
+               && probe.waitForReadyRead(ExitProbeTimeoutMs)) {
+        }
+        QVERIFY2(probe.canReadLine(), qPrintable(QStringLiteral("Exit probe did not start: ") + probe.errorString()));
+
+        timer.start();
+        QVERIFY2(probe.waitForFinished(ExitProbeTimeoutMs), "Exit probe did not quit");
+        samples.append(timer.nsecsElapsed());
+    }
+
+    // 与 QBENCHMARK 的结果使用相同的单位，可以一起与基准比较
+    std::nth_element(samples.begin(), samples.begin() + samples.count() / 2, samples.end());
+    QTest::setBenchmarkResult(samples.at(samples.count() / 2) / 1e6, QTest::WalltimeMilliseconds);
+}
+
+int main(int argc, char *argv[])
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    // 子进程中的 MainWindow 使用单独的 config.ini，不读写用户的设置，用户的设置(如 OpenGL 视口)也不影响测量结果
+    QStandardPaths::setTestModeEnabled(true);
+    QApplication app(argc, argv);
+
+    const QString probeDirectory = qEnvironmentVariable(ExitProbeVariable);
+    if (!probeDirectory.isEmpty()) {
+        return runExitProbe(app, probeDirectory);
+    }
+
+    ViewBenchmark benchmark;
+    return QTest::qExec(&benchmark, argc, argv);
+}
+
+#include "tst_viewbenchmark.moc"